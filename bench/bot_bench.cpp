@@ -0,0 +1,154 @@
+/*
+ * Lets the bot play a fixed game with one thread and with one per hardware
+ * thread, each without and with a transposition table, driving the
+ * simulation tick by tick the same way game() does. Reports how well it
+ * played, how deep the search got within its budget, how many placements it
+ * searched per second and how many of them the table had evaluated.
+ *
+ * Usage: bot_bench [pieces] [--check-budget]
+ *
+ * Decision times depend on the machine and on what else it is running, so
+ * they are only checked when asked to. With --check-budget exits with a
+ * non-zero status when the 99th percentile decision overran its budget by
+ * more than a tick. The first decision of a game, which pays for starting
+ * the workers and touching the table, is left out.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "Bot.hpp"
+#include "Game.hpp"
+
+#define BOT_BENCH_SEED 1
+#define BOT_BENCH_PIECES 500
+
+struct BotBenchResult {
+    std::uint64_t pieces;
+    std::uint64_t lines;
+    std::uint64_t decisions;
+    std::uint64_t depth;
+    std::uint64_t nodes;
+    std::uint64_t table_hits;
+    double search_s;
+    double p99_decision_s;
+    double max_decision_s;
+    bool game_over;
+};
+
+static BotBenchResult
+run(const BotSettings& settings, std::uint64_t piece_limit)
+{
+    Bot bot;
+    Game game(Game::default_settings(), BOT_BENCH_SEED);
+    BotBenchResult result;
+    std::vector<double> decision_s;
+    std::uint64_t decisions;
+    std::chrono::steady_clock::time_point start;
+    double elapsed_s;
+
+    result = {};
+
+    bot.start(settings);
+
+    while ( ! game.game_over() && game.pieces() < piece_limit) {
+        decisions = bot.decisions();
+
+        start = std::chrono::steady_clock::now();
+        bot.play(game, nullptr);
+        elapsed_s = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+
+        if (decisions != bot.decisions()) {
+            result.decisions += bot.decisions() - decisions;
+            result.depth += bot.decision().depth;
+            result.nodes += bot.decision().nodes;
+            result.table_hits += bot.decision().table_hits;
+            result.search_s += elapsed_s;
+            if (0 != decisions) {
+                decision_s.push_back(elapsed_s);
+            }
+        }
+
+        game.tick();
+    }
+
+    bot.stop();
+
+    result.pieces = game.pieces();
+    result.lines = game.lines();
+    result.game_over = game.game_over();
+
+    if ( ! decision_s.empty()) {
+        std::sort(decision_s.begin(), decision_s.end());
+        result.p99_decision_s = decision_s[(decision_s.size() - 1) * 99 / 100];
+        result.max_decision_s = decision_s.back();
+    }
+
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    BotSettings settings;
+    BotBenchResult result;
+    std::uint64_t piece_limit;
+    std::int32_t failures;
+    double budget_s;
+    bool check_budget;
+
+    static const std::int32_t thread_counts[] = { 1, 0 };
+    static const std::int32_t table_bits[] = { 0, Bot::default_settings().table_bits };
+
+    settings = Bot::default_settings();
+    budget_s = std::chrono::duration<double>(settings.budget).count();
+    failures = 0;
+    piece_limit = BOT_BENCH_PIECES;
+    check_budget = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (0 == std::strcmp(argv[i], "--check-budget")) {
+            check_budget = true;
+        } else {
+            piece_limit = std::strtoull(argv[i], nullptr, 10);
+        }
+    }
+
+    for (std::int32_t thread_count : thread_counts) {
+        for (std::int32_t bits : table_bits) {
+            settings.thread_count = thread_count;
+            settings.table_bits = bits;
+
+            result = run(settings, piece_limit);
+
+            std::printf("threads %-3s table %-3s %5llu pieces %5llu lines %-9s "
+                    "depth %4.2f p99 %6.2f max %6.2f ms %8.2f Mnodes/s %5.1f%% hits\n",
+                    0 == thread_count ? "all" : "1",
+                    0 == bits ? "off" : "on",
+                    static_cast<unsigned long long>(result.pieces),
+                    static_cast<unsigned long long>(result.lines),
+                    result.game_over ? "topped" : "survived",
+                    static_cast<double>(result.depth) /
+                        std::max<std::uint64_t>(result.decisions, 1),
+                    result.p99_decision_s * 1e3,
+                    result.max_decision_s * 1e3,
+                    result.nodes / result.search_s / 1e6,
+                    100.0 * result.table_hits / std::max<std::uint64_t>(result.nodes, 1));
+
+            if (check_budget &&
+                    result.p99_decision_s > budget_s + 1.0 / GAME_TICK_RATE) {
+                std::printf("threads %-3s p99 decision took over a tick past the %.2f ms budget\n",
+                        0 == thread_count ? "all" : "1",
+                        budget_s * 1e3);
+                failures++;
+            }
+        }
+    }
+
+    return 0 == failures ? 0 : 1;
+}
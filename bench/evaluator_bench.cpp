@@ -0,0 +1,129 @@
+/*
+ * Evaluates a fixed set of boards with every evaluator kernel the CPU
+ * supports and reports boards per second. Boards come from random
+ * placements of random pieces, started over whenever the stack gets tall,
+ * so that they look like the ones the bot searches.
+ *
+ * Exits with a non-zero status when a batch kernel disagrees with the
+ * scalar one.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "Board.hpp"
+#include "Evaluator.hpp"
+#include "MoveGenerator.hpp"
+#include "Tetromino.hpp"
+
+#define EVALUATOR_BENCH_SEED 1
+#define EVALUATOR_BENCH_BOARDS 4096
+#define EVALUATOR_BENCH_ROUNDS 500
+// Stack is cleared once it reaches this height.
+#define EVALUATOR_BENCH_MAX_HEIGHT 16
+
+static bool
+same_features(const BoardFeatures& a, const BoardFeatures& b)
+{
+    return a.max_height == b.max_height &&
+        a.holes == b.holes &&
+        a.bumpiness == b.bumpiness &&
+        a.row_transitions == b.row_transitions &&
+        a.column_transitions == b.column_transitions &&
+        a.well_depth == b.well_depth &&
+        a.t_slot_lines == b.t_slot_lines;
+}
+
+static void
+make_boards(std::vector<Board>& boards)
+{
+    static MoveGenerator generator;
+    static PlacementList placements;
+    std::mt19937 random(EVALUATOR_BENCH_SEED);
+    std::uint32_t count;
+    std::int32_t type;
+    BoardFeatures features;
+    Board board;
+
+    while (boards.size() < EVALUATOR_BENCH_BOARDS) {
+        type = static_cast<std::int32_t>(random() % TETROMINO_COUNT);
+        count = generator.generate(board, MoveGenerator::spawn(type), placements);
+
+        evaluator_features(board, features);
+        if (0 == count || features.max_height >= EVALUATOR_BENCH_MAX_HEIGHT) {
+            board.clear();
+            continue;
+        }
+
+        const Placement& placement = placements.placements[random() % count];
+        board.place(tetromino_rows(type, placement.rotation), placement.x, placement.y);
+        board.clear_lines();
+
+        boards.push_back(board);
+    }
+}
+
+int main(void)
+{
+    std::vector<Board> boards;
+    std::vector<BoardFeatures> expected;
+    std::vector<BoardFeatures> features;
+    std::chrono::steady_clock::time_point start;
+    double elapsed_s;
+    double scalar_rate;
+    double rate;
+    std::int32_t best;
+    std::int32_t failures;
+    std::uint32_t mismatches;
+
+    make_boards(boards);
+    expected.resize(boards.size());
+    features.resize(boards.size());
+
+    evaluator_features_batch(EVALUATOR_KERNEL_SCALAR, boards.data(), boards.size(), expected.data());
+
+    best = evaluator_detect_kernel();
+    scalar_rate = 0;
+    failures = 0;
+
+    for (std::int32_t kernel = EVALUATOR_KERNEL_SCALAR; kernel <= best; kernel++) {
+        std::memset(features.data(), 0, features.size() * sizeof(BoardFeatures));
+
+        start = std::chrono::steady_clock::now();
+        for (std::int32_t round = 0; round < EVALUATOR_BENCH_ROUNDS; round++) {
+            evaluator_features_batch(kernel, boards.data(), boards.size(), features.data());
+        }
+        elapsed_s = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+
+        rate = static_cast<double>(boards.size()) * EVALUATOR_BENCH_ROUNDS / elapsed_s;
+        if (EVALUATOR_KERNEL_SCALAR == kernel) {
+            scalar_rate = rate;
+        }
+
+        mismatches = 0;
+        for (std::uint32_t i = 0; i < boards.size(); i++) {
+            mismatches += ! same_features(expected[i], features[i]);
+        }
+
+        std::printf("%-8s %8.2f Mboards/s %6.2fx %-8s\n",
+                g_evaluator_kernel_names[kernel],
+                rate / 1e6,
+                rate / scalar_rate,
+                0 == mismatches ? "ok" : "MISMATCH");
+
+        if (0 != mismatches) {
+            std::printf("%-8s %u of %zu boards differ from scalar\n",
+                    g_evaluator_kernel_names[kernel],
+                    mismatches,
+                    boards.size());
+            failures++;
+        }
+    }
+
+    return 0 == failures ? 0 : 1;
+}
@@ -0,0 +1,76 @@
+/*
+ * Cost of log calls which end up discarded, compared to one which is written.
+ * Debug calls are compiled out here, as in a build with
+ * -DLOG_COMPILED_LEVEL=LOG_LEVEL_INFO.
+ */
+
+#define LOG_COMPILED_LEVEL LOG_LEVEL_INFO
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "Log.hpp"
+
+#define LOG_BENCH_ITERATIONS 10000000
+
+// Keeps the compiler from merging or removing loop iterations.
+static inline void
+clobber(void)
+{
+    asm volatile("" ::: "memory");
+}
+
+template<typename F>
+static void
+run(const char* name, std::uint64_t iterations, F body)
+{
+    std::chrono::steady_clock::time_point start;
+    double elapsed_ns;
+
+    start = std::chrono::steady_clock::now();
+    for (std::uint64_t i = 0; i < iterations; i++) {
+        body(i);
+        clobber();
+    }
+    elapsed_ns = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start).count();
+
+    std::printf("%-36s %8.2f ns/call\n", name, elapsed_ns / iterations);
+}
+
+int main(void)
+{
+    std::string message;
+
+    // Written records go nowhere, so that only the producer side is measured.
+    Log::start("/dev/null");
+    Log::set_level(LOG_LEVEL_WARN);
+
+    run("LOG_D, compiled out", LOG_BENCH_ITERATIONS, [](std::uint64_t i) {
+        LOG_D("Iteration {} of {}", i, LOG_BENCH_ITERATIONS);
+    });
+
+    run("LOG_I, below runtime level", LOG_BENCH_ITERATIONS, [](std::uint64_t i) {
+        LOG_I("Iteration {} of {}", i, LOG_BENCH_ITERATIONS);
+    });
+
+    run("Log::d, string built by caller", LOG_BENCH_ITERATIONS, [&message](std::uint64_t i) {
+        message = "Iteration ";
+        message += std::to_string(i);
+        message += " of ";
+        message += std::to_string(LOG_BENCH_ITERATIONS);
+        Log::d(message);
+    });
+
+    // Ring holds a few thousand records, most of these get dropped when the
+    // writer falls behind. Measures the producer side only.
+    run("LOG_W, written", LOG_BENCH_ITERATIONS / 10, [](std::uint64_t i) {
+        LOG_W("Iteration {} of {}", i, LOG_BENCH_ITERATIONS);
+    });
+
+    Log::stop();
+
+    return 0;
+}
@@ -0,0 +1,310 @@
+/*
+ * Counts placement sequences from fixed positions, as chess engines do with
+ * perft. Each node places the next piece of a fixed sequence at every
+ * placement the move generator finds, clearing lines, down to a fixed depth.
+ * Leaf counts are compared to known good ones, so that a change to rotation,
+ * kicks, move generation or line clearing which alters what is reachable gets
+ * noticed. Throughput is reported alongside.
+ *
+ * Every position is counted a second time with a transposition table, so
+ * that subtrees reached by different placement orders are counted once.
+ * This checks hashing and the table against the plain count and reports the
+ * speedup and hit rate. Orders only meet when the same piece comes more than
+ * once within the probed plies, which the oooo and ttii positions are for.
+ * The others get no hits.
+ *
+ * Exits with a non-zero status when a count differs.
+ */
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "Board.hpp"
+#include "MoveGenerator.hpp"
+#include "Tetromino.hpp"
+#include "TranspositionTable.hpp"
+#include "Zobrist.hpp"
+
+#define PERFT_MAX_DEPTH 8
+#define PERFT_MAX_ROWS 12
+// 64 MiB
+#define PERFT_TABLE_BITS 20
+
+struct PerftPosition {
+    const char* name;
+    // Tetromino letters, repeated when shorter than the depth.
+    const char* pieces;
+    std::int32_t depth;
+    std::uint64_t expected;
+    // Top row first, ending at row 0. Unused rows are null.
+    const char* rows[PERFT_MAX_ROWS];
+};
+
+static const PerftPosition g_positions[] = {
+    { "empty", "TIOLJSZ", 5, 7451934, {} },
+    // Repeated pieces, so that placement orders meet and the table gets hits.
+    { "oooo", "O", 4, 6877, {} },
+    { "ttii", "TTII", 4, 386210, {} },
+    { "tsd", "TIOLJSZ", 5, 8057602, {
+        "####......",
+        "###...####",
+        "####.#####",
+    } },
+    { "tst", "TLJ", 4, 1748946, {
+        "....######",
+        "...#######",
+        "....######",
+        "###.######",
+        "###..#####",
+        "###.######",
+    } },
+    { "garbage", "SZTIO", 5, 1881193, {
+        "..#.......",
+        "..##...#..",
+        "#.###.###.",
+        "####.####.",
+        ".######.##",
+        "####.#####",
+        "##.#######",
+        "#######.##",
+    } },
+    { "tall", "IOTLJ", 5, 7888490, {
+        "##.......#",
+        "###......#",
+        "####.#####",
+        "####.#####",
+        "#####.####",
+        "####.#####",
+        "#.########",
+        "##########",
+        "########.#",
+        "#.########",
+        "########.#",
+        "#.########",
+    } },
+};
+
+static std::int32_t
+parse_tetromino(char letter)
+{
+    switch (letter) {
+    case 'I':
+        return TETROMINO_I;
+    case 'J':
+        return TETROMINO_J;
+    case 'L':
+        return TETROMINO_L;
+    case 'O':
+        return TETROMINO_O;
+    case 'S':
+        return TETROMINO_S;
+    case 'T':
+        return TETROMINO_T;
+    case 'Z':
+        return TETROMINO_Z;
+    default:
+        return -1;
+    }
+}
+
+static Board
+parse_board(const PerftPosition& position)
+{
+    Board board;
+    std::int32_t count;
+
+    count = 0;
+    while (count < PERFT_MAX_ROWS && nullptr != position.rows[count]) {
+        count++;
+    }
+
+    for (std::int32_t i = 0; i < count; i++) {
+        for (std::int32_t column = 0; column < BOARD_WIDTH; column++) {
+            if ('#' == position.rows[i][column]) {
+                board.set_cell(column, count - 1 - i);
+            }
+        }
+    }
+
+    return board;
+}
+
+struct Perft {
+    MoveGenerator generator;
+    std::array<PlacementList, PERFT_MAX_DEPTH> placements;
+    std::int32_t types[PERFT_MAX_DEPTH];
+    std::int32_t depth;
+    // Placements generated at every ply, leaves included.
+    std::uint64_t nodes;
+    TranspositionTable table;
+    // Off for the plain count.
+    bool use_table;
+    std::uint64_t probes;
+    std::uint64_t hits;
+};
+
+static std::uint64_t
+perft(Perft& state, const Board& board, std::uint64_t hash, std::int32_t ply)
+{
+    std::int32_t type;
+    std::uint32_t count;
+    std::uint64_t leaves;
+    std::uint64_t position;
+    Board child;
+
+    type = state.types[ply];
+    PlacementList& placements = state.placements[ply];
+
+    // Nothing is held, pieces are told apart by ply. Last ply is left out,
+    // as generating its placements costs about as much as a probe.
+    position = zobrist_position(hash, -1, ply);
+    if (state.use_table && ply + 1 < state.depth) {
+        state.probes++;
+        if (state.table.probe(position, leaves)) {
+            state.hits++;
+            return leaves;
+        }
+    }
+
+    count = state.generator.generate(board, MoveGenerator::spawn(type), placements);
+    state.nodes += count;
+
+    // Leaves are counted without placing them.
+    if (ply + 1 == state.depth) {
+        leaves = count;
+    } else {
+        leaves = 0;
+        for (std::uint32_t i = 0; i < count; i++) {
+            const Placement& placement = placements.placements[i];
+            const PieceRows& rows = tetromino_rows(type, placement.rotation);
+
+            child = board;
+            if (child.place(rows, placement.x, placement.y)) {
+                child.clear_lines();
+                leaves += perft(state, child, zobrist_board(child), ply + 1);
+            } else {
+                leaves += perft(
+                        state,
+                        child,
+                        zobrist_place(hash, rows, placement.x, placement.y),
+                        ply + 1);
+            }
+        }
+    }
+
+    if (state.use_table && ply + 1 < state.depth) {
+        state.table.store(position, leaves);
+    }
+
+    return leaves;
+}
+
+static std::uint64_t
+count_position(Perft& state, const Board& board, bool use_table, double& elapsed_s)
+{
+    std::chrono::steady_clock::time_point start;
+    std::uint64_t leaves;
+
+    state.nodes = 0;
+    state.probes = 0;
+    state.hits = 0;
+    state.use_table = use_table;
+    if (use_table) {
+        state.table.clear();
+    }
+
+    start = std::chrono::steady_clock::now();
+    leaves = perft(state, board, zobrist_board(board), 0);
+    elapsed_s = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+
+    return leaves;
+}
+
+int main(void)
+{
+    static Perft state;
+    double elapsed_s;
+    double table_s;
+    std::uint64_t leaves;
+    std::uint64_t total_nodes;
+    std::uint64_t total_probes;
+    std::uint64_t total_hits;
+    double total_s;
+    double total_table_s;
+    std::int32_t failures;
+    std::size_t length;
+
+    total_nodes = 0;
+    total_probes = 0;
+    total_hits = 0;
+    total_s = 0;
+    total_table_s = 0;
+    failures = 0;
+
+    state.table.resize(PERFT_TABLE_BITS);
+
+    for (const PerftPosition& position : g_positions) {
+        Board board = parse_board(position);
+
+        length = std::strlen(position.pieces);
+        state.depth = position.depth;
+        for (std::int32_t ply = 0; ply < position.depth; ply++) {
+            state.types[ply] = parse_tetromino(position.pieces[ply % length]);
+        }
+
+        leaves = count_position(state, board, false, elapsed_s);
+
+        total_nodes += state.nodes;
+        total_s += elapsed_s;
+
+        std::printf("%-10s depth %d %12llu leaves %-8s %12llu nodes %8.2f Mnodes/s\n",
+                position.name,
+                position.depth,
+                static_cast<unsigned long long>(leaves),
+                position.expected == leaves ? "ok" : "MISMATCH",
+                static_cast<unsigned long long>(state.nodes),
+                state.nodes / elapsed_s / 1e6);
+
+        if (position.expected != leaves) {
+            std::printf("%-10s expected %llu leaves\n",
+                    position.name,
+                    static_cast<unsigned long long>(position.expected));
+            failures++;
+        }
+
+        leaves = count_position(state, board, true, table_s);
+
+        total_probes += state.probes;
+        total_hits += state.hits;
+        total_table_s += table_s;
+
+        std::printf("%-10s table   %12llu leaves %-8s %12llu hits %5.1f%% %8.2fx faster\n",
+                position.name,
+                static_cast<unsigned long long>(leaves),
+                position.expected == leaves ? "ok" : "MISMATCH",
+                static_cast<unsigned long long>(state.hits),
+                100.0 * state.hits / std::max<std::uint64_t>(state.probes, 1),
+                elapsed_s / table_s);
+
+        if (position.expected != leaves) {
+            failures++;
+        }
+    }
+
+    std::printf("%-10s %47llu nodes %8.2f Mnodes/s\n",
+            "total",
+            static_cast<unsigned long long>(total_nodes),
+            total_nodes / total_s / 1e6);
+    std::printf("%-10s table %41llu hits %5.1f%% %8.2fx faster\n",
+            "total",
+            static_cast<unsigned long long>(total_hits),
+            100.0 * total_hits / std::max<std::uint64_t>(total_probes, 1),
+            total_s / total_table_s);
+
+    return 0 == failures ? 0 : 1;
+}
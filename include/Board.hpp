@@ -0,0 +1,155 @@
+#ifndef BOARD_HPP_DEFINED
+#define BOARD_HPP_DEFINED
+
+#include <array>
+#include <cstdint>
+
+/*
+ * Playfield stored as one 16-bit mask per row. Playfield columns occupy bits
+ * BOARD_WALL_LEFT .. BOARD_WALL_LEFT + BOARD_WIDTH - 1, every other bit is a
+ * wall which is always set. Below row 0 there are BOARD_FLOOR_ROWS completely
+ * filled rows acting as floor, and above the top row BOARD_CEILING_ROWS acting
+ * as ceiling, so that collision checks need neither bounds checks nor
+ * per-cell loops.
+ *
+ * Row 0 is the bottom row of the playfield, y grows upwards.
+ *
+ * Pieces are handled as up to four 4-bit row masks (bit 0 being the leftmost
+ * column of the piece box, index 0 being the bottom row of the box). Piece box
+ * is positioned by its bottom left corner.
+ */
+
+#define BOARD_WIDTH 10
+#define BOARD_HEIGHT 40
+#define BOARD_VISIBLE_HEIGHT 20
+#define BOARD_WALL_LEFT 3
+#define BOARD_FLOOR_ROWS 4
+#define BOARD_CEILING_ROWS 4
+#define BOARD_PIECE_ROWS 4
+
+typedef std::uint16_t BoardRow;
+
+// Mask of the playfield columns within a row.
+constexpr BoardRow g_board_row_cells =
+    ((1u << BOARD_WIDTH) - 1) << BOARD_WALL_LEFT;
+constexpr BoardRow g_board_row_empty = static_cast<BoardRow>(~g_board_row_cells);
+constexpr BoardRow g_board_row_full = 0xFFFF;
+
+struct PieceRows {
+    std::uint16_t rows[BOARD_PIECE_ROWS];
+};
+
+class Board
+{
+public:
+    Board();
+
+    void clear();
+
+    /*
+     * Piece box may be positioned partially outside of the playfield, as long
+     * as the occupied cells are not. Everything out of bounds is solid.
+     */
+    bool collides(const PieceRows& piece, std::int32_t x, std::int32_t y) const
+    {
+        std::uint32_t hit;
+        const BoardRow* base;
+
+        if (y < -BOARD_FLOOR_ROWS || y > BOARD_HEIGHT ||
+                x < -BOARD_WALL_LEFT || x > BOARD_WIDTH) {
+            return true;
+        }
+
+        base = &m_rows[y + BOARD_FLOOR_ROWS];
+        hit = 0;
+
+        // Shifted piece row may spill over the 16 bits of a row, treat the
+        // spilled bits as wall.
+        for (std::int32_t i = 0; i < BOARD_PIECE_ROWS; i++) {
+            hit |= (static_cast<std::uint32_t>(piece.rows[i]) << (x + BOARD_WALL_LEFT)) &
+                (base[i] | 0xFFFF0000u);
+        }
+
+        return 0 != hit;
+    }
+
+    /*
+     * Writes piece cells into the playfield. Caller is responsible of having
+     * checked collision beforehand. Returns bitmask of playfield rows, relative
+     * to y, which became full.
+     */
+    std::uint32_t place(const PieceRows& piece, std::int32_t x, std::int32_t y)
+    {
+        std::uint32_t full;
+        BoardRow* base;
+
+        base = &m_rows[y + BOARD_FLOOR_ROWS];
+        full = 0;
+
+        for (std::int32_t i = 0; i < BOARD_PIECE_ROWS; i++) {
+            base[i] |= static_cast<BoardRow>(piece.rows[i] << (x + BOARD_WALL_LEFT));
+            // Floor rows are full as well, but are not part of the playfield.
+            full |= static_cast<std::uint32_t>(
+                    (g_board_row_full == base[i]) & (y + i >= 0)) << i;
+        }
+
+        return full;
+    }
+
+    // Removes full rows, shifting everything above downwards.
+    std::int32_t clear_lines();
+
+    // Bitmask of full rows, bit 0 being row 0. Covers the whole playfield.
+    std::uint64_t full_rows() const;
+
+    // Lowest y at which the piece can rest when dropped from y.
+    std::int32_t drop_distance(const PieceRows& piece, std::int32_t x, std::int32_t y) const
+    {
+        std::int32_t distance;
+
+        distance = 0;
+        while ( ! collides(piece, x, y - distance - 1)) {
+            distance++;
+        }
+
+        return distance;
+    }
+
+    bool cell(std::int32_t column, std::int32_t row) const
+    {
+        return (m_rows[row + BOARD_FLOOR_ROWS] >> (column + BOARD_WALL_LEFT)) & 1;
+    }
+
+    void set_cell(std::int32_t column, std::int32_t row)
+    {
+        m_rows[row + BOARD_FLOOR_ROWS] |= static_cast<BoardRow>(1u << (column + BOARD_WALL_LEFT));
+    }
+
+    // Playfield cells of a row, columns shifted down to bits 0 .. BOARD_WIDTH - 1.
+    std::uint16_t row_cells(std::int32_t row) const
+    {
+        return (m_rows[row + BOARD_FLOOR_ROWS] & g_board_row_cells) >> BOARD_WALL_LEFT;
+    }
+
+    // Row including its walls. Valid down through the floor and up through the
+    // ceiling.
+    BoardRow row(std::int32_t y) const
+    {
+        return m_rows[y + BOARD_FLOOR_ROWS];
+    }
+
+    const BoardRow* rows() const
+    {
+        return &m_rows[BOARD_FLOOR_ROWS];
+    }
+
+    bool operator==(const Board& other) const
+    {
+        return m_rows == other.m_rows;
+    }
+
+private:
+    std::array<BoardRow, BOARD_FLOOR_ROWS + BOARD_HEIGHT + BOARD_CEILING_ROWS> m_rows;
+};
+
+#endif // BOARD_HPP_DEFINED
@@ -0,0 +1,183 @@
+#ifndef BOT_HPP_DEFINED
+#define BOT_HPP_DEFINED
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "Board.hpp"
+#include "Evaluator.hpp"
+#include "Game.hpp"
+#include "MoveGenerator.hpp"
+#include "TaskPool.hpp"
+#include "TranspositionTable.hpp"
+
+/*
+ * Computer player. Placements are chosen by a beam search over the current
+ * piece and the next queue, hold included. Every layer places one more
+ * piece on each board kept from the previous layer, scores the children by
+ * the line clears along the way plus the evaluator's judgement of the
+ * resulting board, and keeps the best beam_width of them. Expanding a layer
+ * is spread over a task pool, each worker with its own move generator.
+ * Children of a node are evaluated in one batch with the widest kernel the
+ * CPU supports.
+ *
+ * Different placement orders often reach the same position. Evaluations are
+ * kept in a transposition table shared by the workers, keyed by the Zobrist
+ * hash of the board, the held piece and the number of the next piece, so
+ * that a position is evaluated once. Table lives on across decisions, as the
+ * next decision searches many of the same positions again.
+ *
+ * Search stops once the budget runs out, dropping the unfinished layer, so
+ * the decision comes from the deepest layer completed. The first layer is
+ * always completed.
+ *
+ * Chosen placement is then played out through the same keys a person
+ * presses, one tap per tick, so that the bot is bound by the game rules and
+ * shows up in replays like anyone else.
+ */
+
+#define BOT_MAX_PIECES (GAME_NEXT_QUEUE_LENGTH + 1)
+// Piece box states the path to a placement is searched over.
+#define BOT_PATH_STATES (TETROMINO_ROTATION_COUNT * 16 * MOVE_GENERATOR_ROWS)
+
+class ReplayRecorder;
+
+struct BotSettings {
+    std::int32_t beam_width;
+    std::chrono::microseconds budget;
+    // Including the game thread, zero picks one per hardware thread.
+    std::int32_t thread_count;
+    // Transposition table of 2^table_bits 64 byte lines, zero for none.
+    std::int32_t table_bits;
+    EvaluatorWeights weights;
+};
+
+struct BotDecision {
+    bool hold;
+    std::int32_t type;
+    Placement placement;
+    // Pieces placed along the best line found.
+    std::int32_t depth;
+    std::uint64_t nodes;
+    // Nodes whose evaluation was found in the transposition table.
+    std::uint64_t table_hits;
+};
+
+class Bot
+{
+public:
+    Bot();
+
+    static BotSettings default_settings();
+
+    void start(const BotSettings& settings);
+    void stop();
+    bool active() const { return m_active; }
+    // Including the game thread.
+    std::int32_t thread_count() const { return m_pool.thread_count(); }
+
+    // Placement for the current piece of game. Game must not be over.
+    BotDecision decide(const Game& game);
+
+    /*
+     * Sets the keys for the tick game is about to run, deciding first when
+     * a new piece came up, and passes them on to recorder when not null.
+     */
+    void play(Game& game, ReplayRecorder* recorder);
+
+    // Latest decision and the count of decisions made since started.
+    const BotDecision& decision() const { return m_decision; }
+    std::uint64_t decisions() const { return m_decisions; }
+
+private:
+    struct Node {
+        Board board;
+        // Of the board alone.
+        std::uint64_t hash;
+        float reward;
+        std::int8_t hold;
+        // Index into m_pieces of the piece to place next.
+        std::uint8_t queue;
+        // Index of the first layer candidate the node descends from.
+        std::uint16_t root;
+    };
+
+    struct Candidate {
+        std::uint64_t hash;
+        float score;
+        float reward;
+        std::uint32_t parent;
+        std::uint16_t root;
+        Placement placement;
+        std::int8_t type;
+        std::int8_t hold;
+        std::uint8_t queue;
+        bool used_hold;
+    };
+
+    struct alignas(64) Worker {
+        MoveGenerator generator;
+        PlacementList placements;
+        // Placed boards of a piece missing from the transposition table,
+        // evaluated in one batch, and the positions they belong to.
+        std::vector<Board> boards;
+        std::vector<BoardFeatures> features;
+        std::vector<std::uint32_t> misses;
+        std::vector<std::uint64_t> miss_hashes;
+        std::vector<Candidate> candidates;
+        std::uint64_t nodes;
+        std::uint64_t table_hits;
+    };
+
+    void expand(std::uint32_t index, std::int32_t worker);
+    void expand_piece(
+            Worker& worker,
+            std::uint32_t index,
+            const ActivePiece& start,
+            std::int32_t hold,
+            std::int32_t queue,
+            bool used_hold);
+
+    std::int32_t find_key(const Game& game);
+    void set_key(Game& game, ReplayRecorder* recorder, std::int32_t key, bool pressed);
+
+    BotSettings m_settings;
+    bool m_active;
+    // EvaluatorKernel
+    std::int32_t m_kernel;
+    TaskPool m_pool;
+    std::vector<Worker> m_workers;
+    TranspositionTable m_table;
+
+    // Search state, valid during decide().
+    std::array<std::int8_t, BOT_MAX_PIECES> m_pieces;
+    std::int32_t m_piece_count;
+    // Number of m_pieces[0] in the whole game.
+    std::uint64_t m_sequence;
+    std::int32_t m_depth;
+    ActivePiece m_start;
+    bool m_root_hold;
+    std::chrono::steady_clock::time_point m_deadline;
+    std::atomic<bool> m_expired;
+    std::vector<Node> m_beam;
+    std::vector<Node> m_next_beam;
+    std::vector<Candidate> m_candidates;
+    std::vector<Candidate> m_roots;
+
+    // Placement being played out.
+    bool m_planned;
+    BotDecision m_decision;
+    std::uint64_t m_decisions;
+    std::uint64_t m_plan_pieces;
+    bool m_hold_pending;
+    std::uint32_t m_keys_down;
+
+    // Path search scratch.
+    std::array<std::uint8_t, BOT_PATH_STATES> m_first_key;
+    std::array<std::uint16_t, BOT_PATH_STATES> m_path_queue;
+};
+
+#endif // BOT_HPP_DEFINED
@@ -0,0 +1,76 @@
+#ifndef EVALUATOR_HPP_DEFINED
+#define EVALUATOR_HPP_DEFINED
+
+#include <cstdint>
+
+#include "Board.hpp"
+
+/*
+ * Features of a board which the bot scores leaf positions by. They depend on
+ * the board alone, rewards for clearing lines are left to the search.
+ */
+
+struct BoardFeatures {
+    // Height of the highest column.
+    std::int32_t max_height;
+    // Empty cells with a filled cell somewhere above them.
+    std::int32_t holes;
+    // Sum of height differences between adjacent columns.
+    std::int32_t bumpiness;
+    // Changes between filled and empty along each row up to the highest
+    // column, walls counting as filled.
+    std::int32_t row_transitions;
+    // Changes between filled and empty along each column up to the highest
+    // column, floor counting as filled.
+    std::int32_t column_transitions;
+    // Depth of the deepest column below both of its neighbours, walls
+    // counting as arbitrarily high.
+    std::int32_t well_depth;
+    // Lines a T piece would clear spinning into the best T slot, zero when
+    // there is no slot.
+    std::int32_t t_slot_lines;
+};
+
+struct EvaluatorWeights {
+    float max_height;
+    float holes;
+    float bumpiness;
+    float row_transitions;
+    float column_transitions;
+    float well_depth;
+    float t_slot_lines;
+};
+
+/*
+ * Batch kernels compute the features of several boards at once, one board
+ * per 16-bit vector lane, and give the same results as evaluator_features().
+ */
+enum EvaluatorKernel {
+    EVALUATOR_KERNEL_SCALAR = 0,
+    // 8 boards per step, baseline on x86-64.
+    EVALUATOR_KERNEL_SSE2,
+    // 16 boards per step.
+    EVALUATOR_KERNEL_AVX2,
+    EVALUATOR_KERNEL_COUNT,
+};
+
+extern const char* const g_evaluator_kernel_names[EVALUATOR_KERNEL_COUNT];
+
+EvaluatorWeights evaluator_default_weights();
+
+void evaluator_features(const Board& board, BoardFeatures& features);
+
+// Widest kernel the CPU supports, as told by CPUID.
+std::int32_t evaluator_detect_kernel();
+
+// Kernel must be supported by the CPU.
+void evaluator_features_batch(
+        std::int32_t kernel,
+        const Board* boards,
+        std::uint32_t count,
+        BoardFeatures* features);
+
+// Higher is better.
+float evaluator_score(const BoardFeatures& features, const EvaluatorWeights& weights);
+
+#endif // EVALUATOR_HPP_DEFINED
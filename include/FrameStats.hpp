@@ -0,0 +1,69 @@
+#ifndef FRAME_STATS_HPP_DEFINED
+#define FRAME_STATS_HPP_DEFINED
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+/*
+ * Durations of the phases of drawing a frame, kept for the most recent
+ * FRAME_STATS_WINDOW samples of each phase. Percentiles are only computed
+ * when asked for, adding a sample is a store into a ring.
+ */
+
+#define FRAME_STATS_WINDOW 4096 // Power of two
+
+enum FramePhase {
+    FRAME_PHASE_ACQUIRE = 0,
+    FRAME_PHASE_RECORD,
+    FRAME_PHASE_SUBMIT,
+    FRAME_PHASE_PRESENT,
+    // CPU time of a whole draw_frame() call which produced a frame.
+    FRAME_PHASE_CPU_TOTAL,
+    // Render pass execution on the GPU, from timestamp queries.
+    FRAME_PHASE_GPU_RENDER,
+    // Stall of replacing the swapchain after a resize, not per frame.
+    FRAME_PHASE_RECREATE,
+    /*
+     * From the timestamp of a key press to presenting the first frame
+     * simulated after it. Proxy of input to photon latency, lacking the time the image waits
+     * in the presentation engine and the display.
+     */
+    FRAME_PHASE_INPUT_LATENCY,
+    FRAME_PHASE_COUNT,
+};
+
+struct FramePhaseSummary {
+    std::uint64_t count;
+    std::uint64_t p50_ns;
+    std::uint64_t p99_ns;
+    std::uint64_t max_ns;
+};
+
+class FrameStats
+{
+public:
+    FrameStats();
+
+    void add(std::int32_t phase, std::uint64_t duration_ns)
+    {
+        m_samples[phase][m_counts[phase] & (FRAME_STATS_WINDOW - 1)] =
+            static_cast<std::uint32_t>(
+                    duration_ns > UINT32_MAX ? UINT32_MAX : duration_ns);
+        m_counts[phase]++;
+    }
+
+    // Over the samples currently in the window, count is all time.
+    FramePhaseSummary summarize(std::int32_t phase) const;
+
+    void log() const;
+
+    // One row per phase. Throws std::runtime_error when writing fails.
+    void write_csv(const std::string& path) const;
+
+private:
+    std::array<std::array<std::uint32_t, FRAME_STATS_WINDOW>, FRAME_PHASE_COUNT> m_samples;
+    std::array<std::uint64_t, FRAME_PHASE_COUNT> m_counts;
+};
+
+#endif // FRAME_STATS_HPP_DEFINED
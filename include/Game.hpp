@@ -0,0 +1,183 @@
+#ifndef GAME_HPP_DEFINED
+#define GAME_HPP_DEFINED
+
+#include <array>
+#include <cstdint>
+
+#include "Board.hpp"
+#include "Randomizer.hpp"
+#include "Tetromino.hpp"
+
+/*
+ * Game simulation advanced in fixed steps. All durations are expressed in
+ * ticks and the simulation does not know about wall clock time, so the same
+ * inputs at the same ticks always produce the same game.
+ */
+
+#define GAME_TICK_RATE 60
+#define GAME_NEXT_QUEUE_LENGTH 5
+
+// Gravity is expressed in 1/GAME_GRAVITY_ONE rows per tick.
+#define GAME_GRAVITY_ONE 65536
+
+// Time within a tick is expressed in 1/GAME_SUBTICK_ONE ticks.
+#define GAME_SUBTICK_ONE 65536
+
+enum GameKey {
+    GAME_KEY_LEFT = 0,
+    GAME_KEY_RIGHT,
+    GAME_KEY_SOFT_DROP,
+    GAME_KEY_HARD_DROP,
+    GAME_KEY_ROTATE_CW,
+    GAME_KEY_ROTATE_CCW,
+    GAME_KEY_HOLD,
+    GAME_KEY_COUNT,
+};
+
+struct GameSettings {
+    std::int32_t das_ticks;
+    std::int32_t arr_ticks;
+    std::int32_t gravity;
+    std::int32_t soft_drop_factor;
+    std::int32_t lock_delay_ticks;
+    std::int32_t lock_reset_limit;
+    // RandomizerMode
+    std::int32_t randomizer;
+};
+
+struct ActivePiece {
+    std::int32_t type;
+    std::int32_t rotation;
+    std::int32_t x;
+    std::int32_t y;
+};
+
+/*
+ * Whole simulation state in a fixed layout, as stored in replay keyframes.
+ * Board is rebuilt from the cell types, which cover every row a piece can
+ * reach before the game is over. Randomizer is rebuilt from the seed and the
+ * count of pieces taken.
+ */
+struct GameSnapshot {
+    std::uint64_t seed;
+    std::uint64_t pieces;
+    std::uint64_t ticks;
+    std::uint64_t lines;
+    std::uint64_t version;
+
+    std::int32_t das_counter;
+    std::int32_t arr_counter;
+    std::int32_t gravity_accumulator;
+    std::int32_t lock_counter;
+    std::int32_t lock_resets;
+    std::uint16_t press_ages[GAME_KEY_COUNT];
+
+    std::int8_t piece_type;
+    std::int8_t piece_rotation;
+    std::int8_t piece_x;
+    std::int8_t piece_y;
+    std::int8_t hold;
+    std::int8_t shift_direction;
+    std::uint8_t hold_used;
+    std::uint8_t game_over;
+    std::uint8_t keys_down;
+    std::uint8_t keys_pressed;
+    std::uint8_t reserved[4];
+
+    // Type + 1 per cell, two cells per byte, low nibble first.
+    std::uint8_t cells[BOARD_WIDTH * BOARD_HEIGHT / 2];
+};
+
+static_assert(288 == sizeof(GameSnapshot), "GameSnapshot layout is part of the replay format");
+
+class Game
+{
+public:
+    Game(const GameSettings& settings, std::uint64_t seed);
+
+    static GameSettings default_settings();
+
+    void reset(std::uint64_t seed);
+
+    void save(GameSnapshot& snapshot) const;
+    // Settings are not part of a snapshot and stay as they are.
+    void restore(const GameSnapshot& snapshot);
+
+    /*
+     * Key transitions are latched and take effect on the next tick, so that a
+     * press and release in between two ticks is not lost. age tells how long
+     * before the next tick a press happened, in subticks. Auto shift is
+     * charged from the press rather than from the tick.
+     */
+    void set_key(std::int32_t key, bool pressed, std::int32_t age);
+
+    void tick();
+
+    const Board& board() const { return m_board; }
+
+    // Type of the tetromino which left the block at a cell, -1 when empty.
+    std::int32_t cell_type(std::int32_t column, std::int32_t row) const
+    {
+        return static_cast<std::int32_t>(m_cell_types[row * BOARD_WIDTH + column]) - 1;
+    }
+
+    const ActivePiece& piece() const { return m_piece; }
+    std::int32_t ghost_y() const;
+    std::int32_t hold() const { return m_hold; }
+    // Hold can be used once per piece.
+    bool hold_used() const { return m_hold_used; }
+    std::int32_t next(std::int32_t i) const;
+    bool game_over() const { return m_game_over; }
+    std::uint64_t ticks() const { return m_ticks; }
+    std::uint64_t lines() const { return m_lines; }
+    std::uint64_t pieces() const { return m_randomizer.taken(); }
+    std::uint64_t seed() const { return m_seed; }
+    const GameSettings& settings() const { return m_settings; }
+
+    // Incremented whenever something visible changes.
+    std::uint64_t version() const { return m_version; }
+
+private:
+    void spawn(std::int32_t type);
+    std::int32_t take_next();
+    bool try_move(std::int32_t dx, std::int32_t dy);
+    void shift(std::int32_t direction, std::int32_t key);
+    void on_moved();
+    void lock();
+
+    GameSettings m_settings;
+    std::uint64_t m_seed;
+    Randomizer m_randomizer;
+
+    Board m_board;
+    ActivePiece m_piece;
+
+    // Only needed for drawing, kept out of the bitboard. Type + 1 per cell.
+    std::array<std::uint8_t, BOARD_WIDTH * BOARD_HEIGHT> m_cell_types;
+
+    std::int32_t m_hold;
+    bool m_hold_used;
+
+    std::uint32_t m_keys_down;
+    std::uint32_t m_keys_pressed;
+    std::array<std::int32_t, GAME_KEY_COUNT> m_press_ages;
+
+    // In subticks.
+    std::int32_t m_das_counter;
+    std::int32_t m_arr_counter;
+    std::int32_t m_shift_direction;
+
+    std::int32_t m_gravity_accumulator;
+    std::int32_t m_lock_counter;
+    std::int32_t m_lock_resets;
+
+    bool m_game_over;
+    std::uint64_t m_ticks;
+    std::uint64_t m_lines;
+    std::uint64_t m_version;
+};
+
+static_assert(GAME_NEXT_QUEUE_LENGTH <= RANDOMIZER_BAG_SIZE,
+        "Next queue is peeked from the randomizer");
+
+#endif // GAME_HPP_DEFINED
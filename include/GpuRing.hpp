@@ -0,0 +1,78 @@
+#ifndef GPU_RING_HPP_DEFINED
+#define GPU_RING_HPP_DEFINED
+
+#include <cstdint>
+#include <vector>
+
+#ifdef __linux__
+#include <vulkan/vulkan.h>
+#endif
+
+/*
+ * One large host coherent buffer, mapped for its whole lifetime. The buffer
+ * is split into two parts:
+ *
+ * - Static part, allocated linearly at setup and never freed. For data which
+ *   outlives a frame, such as contents referenced by prerecorded commands.
+ * - Ring part, sub-allocated per frame. A region allocated during a frame is
+ *   reclaimed once the frame slot it belongs to comes around again, as the
+ *   caller only begins a frame slot after the fence of its previous use has
+ *   signaled.
+ *
+ * Allocating never calls into Vulkan.
+ */
+class GpuRing
+{
+public:
+    struct Allocation {
+        void* data;
+        VkDeviceSize offset;
+    };
+
+    GpuRing();
+
+    void create(
+            const VkPhysicalDevice& physical_device,
+            const VkDevice& logical_device,
+            VkBufferUsageFlags usage,
+            VkDeviceSize static_size,
+            VkDeviceSize ring_size,
+            std::uint32_t frame_slot_count);
+
+    void destroy(const VkDevice& logical_device);
+
+    /*
+     * Must only be called once the fence of the previous frame which used
+     * frame_slot has signaled. Everything allocated up to the end of that
+     * frame becomes free.
+     */
+    void begin_frame(std::uint32_t frame_slot);
+
+    struct Allocation allocate(VkDeviceSize size, VkDeviceSize alignment);
+    struct Allocation allocate_static(VkDeviceSize size, VkDeviceSize alignment);
+
+    VkBuffer buffer() const { return m_buffer; }
+
+private:
+    VkBuffer m_buffer;
+    VkDeviceMemory m_memory;
+    std::uint8_t* m_mapped;
+
+    VkDeviceSize m_static_size;
+    VkDeviceSize m_static_head;
+    VkDeviceSize m_ring_size;
+
+    // Monotonic positions within the ring, offset is position % ring size.
+    std::uint64_t m_head;
+    std::uint64_t m_tail;
+
+    std::vector<std::uint64_t> m_frame_end;
+    std::uint32_t m_frame_slot;
+};
+
+std::uint32_t gpu_find_memory_type(
+        const VkPhysicalDevice& physical_device,
+        std::uint32_t type_bits,
+        VkMemoryPropertyFlags properties);
+
+#endif // GPU_RING_HPP_DEFINED
@@ -0,0 +1,30 @@
+#ifndef IMAGE_WRITER_HPP_DEFINED
+#define IMAGE_WRITER_HPP_DEFINED
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Writes 8-bit RGBA pixels, rows from top to bottom, row_pitch bytes apart.
+ * Throws std::runtime_error when the file cannot be written.
+ */
+
+// PNG with uncompressed deflate blocks, trading file size for encoding speed
+// and for not needing zlib.
+void image_write_png(
+        const std::string& path,
+        const std::uint8_t* pixels,
+        std::uint32_t width,
+        std::uint32_t height,
+        std::size_t row_pitch);
+
+// Bare pixels without any header, width * 4 bytes per row.
+void image_write_raw(
+        const std::string& path,
+        const std::uint8_t* pixels,
+        std::uint32_t width,
+        std::uint32_t height,
+        std::size_t row_pitch);
+
+#endif // IMAGE_WRITER_HPP_DEFINED
@@ -0,0 +1,78 @@
+#ifndef INPUT_HPP_DEFINED
+#define INPUT_HPP_DEFINED
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#ifdef __linux__
+#include <SDL2/SDL.h>
+#endif
+
+#include "Game.hpp"
+
+/*
+ * Key transitions stamped with the time SDL received them, queued for the
+ * simulation. Stamping happens in an SDL event watch, which runs whenever
+ * events get pumped. Each transition is applied right before the tick whose
+ * period it happened in, no matter how late the frame loop gets to run that
+ * tick.
+ *
+ * Queue is single producer, single consumer and never blocks. SDL serializes
+ * event watch calls. Transitions arriving to a full queue are dropped.
+ */
+
+#define INPUT_QUEUE_CAPACITY 256 // Power of two
+
+class ReplayRecorder;
+
+struct InputEvent {
+    std::chrono::steady_clock::time_point time;
+    std::int32_t key;
+    bool pressed;
+};
+
+class Input
+{
+public:
+    Input();
+
+    // SDL must have been initialized.
+    void start();
+    void stop();
+
+    /*
+     * Applies transitions which happened by tick_end to game, aged relative
+     * to tick_end, and passes them on to recorder when not null. Returns time
+     * of the earliest key press applied, or a default constructed time point
+     * when there was none.
+     */
+    std::chrono::steady_clock::time_point apply(
+            Game& game,
+            std::chrono::steady_clock::time_point tick_end,
+            std::chrono::steady_clock::duration tick_duration,
+            ReplayRecorder* recorder);
+
+    std::uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    static int on_event(void* userdata, SDL_Event* event);
+
+    std::array<InputEvent, INPUT_QUEUE_CAPACITY> m_events;
+
+    // Monotonic positions, written by producer and consumer respectively.
+    alignas(64) std::atomic<std::uint32_t> m_head;
+    alignas(64) std::atomic<std::uint32_t> m_tail;
+
+    std::atomic<std::uint64_t> m_dropped;
+};
+
+/*
+ * Sleeps until shortly before deadline and spins the rest. Events are pumped
+ * in between, so that transitions get stamped close to when they happened
+ * even while waiting for a long time.
+ */
+void input_wait_until(std::chrono::steady_clock::time_point deadline);
+
+#endif // INPUT_HPP_DEFINED
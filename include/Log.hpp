@@ -1,24 +1,118 @@
 #ifndef LOG_HPP_DEFINED
 #define LOG_HPP_DEFINED
 
+#include <atomic>
 #include <string>
+#include <string_view>
 #include <iostream>
 
-#define WARN "[W] "
-#define INFO "[I] "
-#define ERR "[E] "
-#define DBG "[D] "
+#include "LogRecord.hpp"
+
+/*
+ * Messages are copied into fixed size records of a lock-free ring buffer and
+ * written out in batches by a background thread, so that logging neither
+ * allocates nor blocks the calling thread. Messages longer than a record are
+ * truncated, and messages are dropped when the ring is full.
+ *
+ * Logging works before start(), records are just held until the writer
+ * thread is running. A crash signal drains the ring before terminating.
+ *
+ * LOG_D/I/W/E take a format string literal with {} placeholders and capture
+ * the arguments in binary form, formatting is done by the writer thread. When
+ * a binary log is written, formatting is left for tools/log_decode instead.
+ *
+ * Calls below LOG_COMPILED_LEVEL are removed at compile time, calls below the
+ * runtime level return before evaluating any arguments.
+ */
+
+#ifndef LOG_COMPILED_LEVEL
+#define LOG_COMPILED_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+#define LOG_AT(level, format, ...) \
+    do { \
+        if constexpr ((level) >= LOG_COMPILED_LEVEL) { \
+            if (Log::enabled(level)) { \
+                static const LogFormat log_format_(level, format); \
+                Log::write(log_format_, ##__VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+
+#define LOG_D(format, ...) LOG_AT(LOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+#define LOG_I(format, ...) LOG_AT(LOG_LEVEL_INFO, format, ##__VA_ARGS__)
+#define LOG_W(format, ...) LOG_AT(LOG_LEVEL_WARN, format, ##__VA_ARGS__)
+#define LOG_E(format, ...) LOG_AT(LOG_LEVEL_ERROR, format, ##__VA_ARGS__)
+
+// Format string of a logging call site, gets its id when first reached.
+class LogFormat
+{
+public:
+    LogFormat(std::uint8_t level, const char* format);
+
+    std::uint32_t id() const { return m_id; }
+    std::uint8_t level() const { return m_level; }
+    const char* format() const { return m_format; }
+
+private:
+    std::uint32_t m_id;
+    std::uint8_t m_level;
+    const char* m_format;
+};
 
 class Log
 {
 public:
-    static void w(std::string msg);
-    static void i(std::string msg);
-    static void e(std::string msg);
-    static void d(std::string msg);
+    /*
+     * Starts the writer thread. Records are formatted to stdout, or when
+     * binary_path is not empty, written to that file unformatted.
+     */
+    static void start(const std::string& binary_path);
+
+    // Writes out everything logged so far and stops the writer thread.
+    static void stop();
+
+    // Messages below level are discarded. Default is LOG_LEVEL_INFO.
+    static void set_level(std::int32_t level)
+    {
+        m_level.store(level, std::memory_order_relaxed);
+    }
+
+    static bool enabled(std::int32_t level)
+    {
+        return level >= m_level.load(std::memory_order_relaxed);
+    }
+
+    static void w(std::string_view msg);
+    static void i(std::string_view msg);
+    static void e(std::string_view msg);
+    static void d(std::string_view msg);
+
+    template<typename... Args>
+    static void write(const LogFormat& format, const Args&... args)
+    {
+        std::uint8_t data[sizeof(LogRecord::data)];
+        std::uint32_t id;
+
+        id = format.id();
+        std::memcpy(data, &id, sizeof(id));
+
+        log_detail::ArgWriter writer(&data[sizeof(id)], sizeof(data) - sizeof(id));
+        (log_detail::encode(writer, args), ...);
+
+        Log::push(format.level(), LOG_RECORD_ARGS, data, sizeof(id) + writer.used());
+    }
+
+    static std::uint32_t register_format(const LogFormat* format);
 
 private:
-    static void log(std::string msg);
+    static inline std::atomic<std::int32_t> m_level = LOG_LEVEL_INFO;
+
+    static void push(
+            std::uint8_t level,
+            std::uint8_t type,
+            const void* data,
+            std::size_t size);
 };
 
 #endif // LOG_HPP_DEFINED
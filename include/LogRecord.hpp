@@ -0,0 +1,189 @@
+#ifndef LOG_RECORD_HPP_DEFINED
+#define LOG_RECORD_HPP_DEFINED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+/*
+ * Fixed size log records, as passed from logging threads to the log writer
+ * and stored in binary log files. Records either carry ready text, or the id
+ * of a format string registered at the call site followed by its arguments
+ * in binary form, so that formatting can be left for the writer thread or
+ * for the offline decoder.
+ */
+
+#define WARN "[W] "
+#define INFO "[I] "
+#define ERR "[E] "
+#define DBG "[D] "
+
+#define LOG_RECORD_SIZE 256
+#define LOG_RECORD_HEADER_SIZE 12
+#define LOG_MAX_FORMATS 4096
+
+// Longest line produced by log_format_line(), including the newline.
+#define LOG_LINE_MAX 1024
+
+#define LOG_BINARY_MAGIC "NTLOG001"
+#define LOG_BINARY_MAGIC_SIZE 8
+
+enum LogLevel {
+    LOG_LEVEL_DEBUG = 0,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_COUNT,
+};
+
+enum LogRecordType {
+    LOG_RECORD_TEXT = 0,
+    // Data starts with format id, followed by encoded arguments.
+    LOG_RECORD_ARGS,
+};
+
+enum LogArgType {
+    LOG_ARG_I32 = 0,
+    LOG_ARG_U32,
+    LOG_ARG_I64,
+    LOG_ARG_U64,
+    LOG_ARG_F64,
+    // Followed by 16-bit length and the characters.
+    LOG_ARG_STRING,
+};
+
+/*
+ * Binary log files consist of LOG_BINARY_MAGIC followed by entries. Format
+ * entries precede the first record using the format. Multi-byte fields are
+ * in host byte order.
+ */
+enum LogBinaryEntry {
+    // u32 id, u8 level, u16 length, format string
+    LOG_ENTRY_FORMAT = 1,
+    // Record header and length bytes of data
+    LOG_ENTRY_RECORD,
+};
+
+struct LogRecord {
+    std::int64_t time_ms;
+    std::uint16_t length;
+    std::uint8_t type;
+    std::uint8_t level;
+    std::uint8_t data[LOG_RECORD_SIZE - LOG_RECORD_HEADER_SIZE];
+};
+
+static_assert(LOG_RECORD_SIZE == sizeof(LogRecord), "LogRecord has padding");
+
+extern const char* const g_log_level_prefixes[LOG_LEVEL_COUNT];
+
+/*
+ * Formats a record as one line of text. format is only used by records of
+ * type LOG_RECORD_ARGS and may be null when the format is not known. Does not
+ * allocate, so it can be used from a signal handler.
+ */
+std::size_t
+log_format_line(const LogRecord& record, const char* format, char* out);
+
+// Format id of an argument record.
+inline std::uint32_t
+log_record_format_id(const LogRecord& record)
+{
+    std::uint32_t id;
+
+    std::memcpy(&id, record.data, sizeof(id));
+
+    return id;
+}
+
+namespace log_detail {
+
+// Appends arguments to record data, silently truncating what does not fit.
+class ArgWriter
+{
+public:
+    ArgWriter(std::uint8_t* data, std::size_t capacity) :
+        m_data(data),
+        m_used(0),
+        m_capacity(capacity)
+    {
+    }
+
+    std::size_t used() const { return m_used; }
+
+    void put(std::uint8_t type, const void* value, std::size_t size)
+    {
+        if (m_capacity - m_used < 1 + size) {
+            m_used = m_capacity;
+            return;
+        }
+
+        m_data[m_used] = type;
+        std::memcpy(&m_data[m_used + 1], value, size);
+        m_used += 1 + size;
+    }
+
+    void put_string(std::string_view value)
+    {
+        std::uint16_t length;
+
+        if (m_capacity - m_used < 1 + sizeof(length)) {
+            m_used = m_capacity;
+            return;
+        }
+
+        length = static_cast<std::uint16_t>(std::min(
+                    value.size(),
+                    m_capacity - m_used - 1 - sizeof(length)));
+        m_data[m_used] = LOG_ARG_STRING;
+        std::memcpy(&m_data[m_used + 1], &length, sizeof(length));
+        std::memcpy(&m_data[m_used + 1 + sizeof(length)], value.data(), length);
+        m_used += 1 + sizeof(length) + length;
+    }
+
+private:
+    std::uint8_t* m_data;
+    std::size_t m_used;
+    std::size_t m_capacity;
+};
+
+template<typename T>
+struct always_false : std::false_type {};
+
+template<typename T>
+inline void
+encode(ArgWriter& writer, const T& value)
+{
+    if constexpr (std::is_enum_v<T>) {
+        encode(writer, static_cast<std::underlying_type_t<T>>(value));
+    } else if constexpr (std::is_integral_v<T> && sizeof(T) <= 4) {
+        if constexpr (std::is_signed_v<T>) {
+            std::int32_t widened = value;
+            writer.put(LOG_ARG_I32, &widened, sizeof(widened));
+        } else {
+            std::uint32_t widened = value;
+            writer.put(LOG_ARG_U32, &widened, sizeof(widened));
+        }
+    } else if constexpr (std::is_integral_v<T> && sizeof(T) == 8) {
+        if constexpr (std::is_signed_v<T>) {
+            std::int64_t widened = value;
+            writer.put(LOG_ARG_I64, &widened, sizeof(widened));
+        } else {
+            std::uint64_t widened = value;
+            writer.put(LOG_ARG_U64, &widened, sizeof(widened));
+        }
+    } else if constexpr (std::is_floating_point_v<T>) {
+        double widened = value;
+        writer.put(LOG_ARG_F64, &widened, sizeof(widened));
+    } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+        writer.put_string(std::string_view(value));
+    } else {
+        static_assert(always_false<T>::value, "Unsupported log argument type");
+    }
+}
+
+} // namespace log_detail
+
+#endif // LOG_RECORD_HPP_DEFINED
@@ -0,0 +1,76 @@
+#ifndef MOVE_GENERATOR_HPP_DEFINED
+#define MOVE_GENERATOR_HPP_DEFINED
+
+#include <array>
+#include <cstdint>
+
+#include "Board.hpp"
+#include "Game.hpp"
+#include "Tetromino.hpp"
+
+/*
+ * Enumerates every final placement a piece can reach from a starting state by
+ * shifting, soft dropping and rotating with SRS kicks, spins and tucks
+ * included. Gravity and lock delay are not limiting, as if the player were
+ * arbitrarily fast.
+ *
+ * The search is a breadth-first flood over (x, y, rotation) states. Visited
+ * states are kept as one bit per x in a row mask per rotation and y, the same
+ * layout the board uses, so that a whole row of states is expanded with a few
+ * shifts and masks instead of one collision check per state.
+ *
+ * Placements covering the same cells are reported once, e.g. an I piece lying
+ * flat in spawn orientation and upside down.
+ */
+
+// Piece box positions y from -BOARD_FLOOR_ROWS to BOARD_HEIGHT.
+#define MOVE_GENERATOR_ROWS (BOARD_FLOOR_ROWS + BOARD_HEIGHT + 1)
+#define MOVE_GENERATOR_MAX_PLACEMENTS \
+    (TETROMINO_ROTATION_COUNT * BOARD_WIDTH * MOVE_GENERATOR_ROWS)
+
+struct Placement {
+    std::int8_t rotation;
+    std::int8_t x;
+    std::int8_t y;
+};
+
+struct PlacementList {
+    std::uint32_t count;
+    std::array<Placement, MOVE_GENERATOR_MAX_PLACEMENTS> placements;
+};
+
+/*
+ * Holds the scratch state of a search, so that generating does not allocate.
+ * One generator per thread.
+ */
+class MoveGenerator
+{
+public:
+    MoveGenerator();
+
+    // State of a freshly spawned piece.
+    static ActivePiece spawn(std::int32_t type);
+
+    /*
+     * Fills placements with every placement reachable from start, ordered by
+     * rotation, then y, then x. Returns the count, zero when start collides.
+     */
+    std::uint32_t generate(
+            const Board& board,
+            const ActivePiece& start,
+            PlacementList& placements);
+
+private:
+    // Free positions of a rotation at a row, bit x + BOARD_WALL_LEFT set when
+    // the piece box fits there.
+    std::array<std::array<std::uint16_t, MOVE_GENERATOR_ROWS>, TETROMINO_ROTATION_COUNT> m_free;
+    std::array<std::array<std::uint16_t, MOVE_GENERATOR_ROWS>, TETROMINO_ROTATION_COUNT> m_reached;
+    // Bit i set when rows i and i + 1 of m_free are the same.
+    std::array<std::uint64_t, TETROMINO_ROTATION_COUNT> m_uniform;
+    // Reached by a rotation, not yet spread by shifting and dropping.
+    std::array<std::array<std::uint16_t, MOVE_GENERATOR_ROWS>, TETROMINO_ROTATION_COUNT> m_pending;
+    // Reached by shifting and dropping, not yet rotated.
+    std::array<std::array<std::uint16_t, MOVE_GENERATOR_ROWS>, TETROMINO_ROTATION_COUNT> m_fresh;
+};
+
+#endif // MOVE_GENERATOR_HPP_DEFINED
@@ -0,0 +1,39 @@
+#ifndef PIPELINE_CACHE_HPP_DEFINED
+#define PIPELINE_CACHE_HPP_DEFINED
+
+#include <string>
+
+#ifdef __linux__
+#include <vulkan/vulkan.h>
+#endif
+
+/*
+ * VkPipelineCache persisted to the user cache directory between runs, so that
+ * the driver does not need to compile shaders again on subsequent launches.
+ *
+ * Cache file is only used when it was written for the same device and driver
+ * version, anything else is silently discarded. Failing to read or write the
+ * file is never fatal.
+ */
+class PipelineCache
+{
+public:
+    PipelineCache();
+
+    void load(const VkPhysicalDevice& physical_device, const VkDevice& logical_device);
+    void save(const VkDevice& logical_device);
+    void destroy(const VkDevice& logical_device);
+
+    VkPipelineCache handle() const { return m_cache; }
+
+    // True when cache was populated from disk.
+    bool warm() const { return m_warm; }
+
+private:
+    VkPipelineCache m_cache;
+    bool m_warm;
+    std::string m_path;
+    VkPhysicalDeviceProperties m_properties;
+};
+
+#endif // PIPELINE_CACHE_HPP_DEFINED
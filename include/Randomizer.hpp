@@ -0,0 +1,118 @@
+#ifndef RANDOMIZER_HPP_DEFINED
+#define RANDOMIZER_HPP_DEFINED
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "Tetromino.hpp"
+
+/*
+ * Piece sequence generation. A sequence depends on nothing but the mode and
+ * the seed. It is built on xoshiro256** seeded through splitmix64, not on
+ * standard library engines or distributions, so that replays and netplay
+ * peers reproduce it on any platform.
+ *
+ * Pieces are generated in batches of whole bags into a ring, so that taking
+ * a piece is a load in the common case.
+ */
+
+#define RANDOMIZER_RING_SIZE 1024 // Power of two
+#define RANDOMIZER_BAG_SIZE TETROMINO_COUNT
+
+enum RandomizerMode {
+    // Every run of seven holds each tetromino once, in random order.
+    RANDOMIZER_BAG = 0,
+    // Every piece drawn independently and uniformly.
+    RANDOMIZER_CLASSIC,
+    RANDOMIZER_MODE_COUNT,
+};
+
+class Xoshiro256
+{
+public:
+    void seed(std::uint64_t seed);
+
+    std::uint64_t next()
+    {
+        std::uint64_t result;
+        std::uint64_t t;
+
+        result = rotl(m_state[1] * 5, 7) * 9;
+        t = m_state[1] << 17;
+
+        m_state[2] ^= m_state[0];
+        m_state[3] ^= m_state[1];
+        m_state[1] ^= m_state[2];
+        m_state[0] ^= m_state[3];
+        m_state[2] ^= t;
+        m_state[3] = rotl(m_state[3], 45);
+
+        return result;
+    }
+
+    // Uniform in [0, bound) without modulo bias.
+    std::uint32_t bounded(std::uint32_t bound);
+
+private:
+    static std::uint64_t rotl(std::uint64_t x, std::int32_t k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    std::uint64_t m_state[4];
+};
+
+class Randomizer
+{
+public:
+    Randomizer(std::int32_t mode, std::uint64_t seed);
+
+    void reset(std::uint64_t seed);
+
+    std::int32_t next()
+    {
+        std::int32_t piece;
+
+        piece = m_pieces[m_head & (RANDOMIZER_RING_SIZE - 1)];
+        m_head++;
+
+        if (m_tail - m_head < RANDOMIZER_BAG_SIZE) {
+            fill();
+        }
+
+        return piece;
+    }
+
+    // Upcoming piece i without taking it. At least a bag is always ahead.
+    std::int32_t peek(std::uint32_t i) const
+    {
+        return m_pieces[(m_head + i) & (RANDOMIZER_RING_SIZE - 1)];
+    }
+
+    // Takes count pieces at once, same as calling next() count times.
+    void take(std::uint8_t* pieces, std::size_t count);
+
+    // Same as calling next() count times, without looking at the pieces.
+    void discard(std::uint64_t count);
+
+    // Pieces taken since reset.
+    std::uint64_t taken() const { return m_head; }
+
+    std::int32_t mode() const { return m_mode; }
+
+private:
+    // Appends whole bags until there is no room for another one.
+    void fill();
+
+    std::int32_t m_mode;
+    Xoshiro256 m_random;
+
+    std::array<std::uint8_t, RANDOMIZER_RING_SIZE> m_pieces;
+
+    // Monotonic positions, index is position % ring size.
+    std::uint64_t m_head;
+    std::uint64_t m_tail;
+};
+
+#endif // RANDOMIZER_HPP_DEFINED
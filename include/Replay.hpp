@@ -0,0 +1,149 @@
+#ifndef REPLAY_HPP_DEFINED
+#define REPLAY_HPP_DEFINED
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Game.hpp"
+
+/*
+ * Replays store the key transitions fed to the simulation, which is enough to
+ * reproduce a game as the simulation is deterministic. File layout:
+ *
+ *   ReplayHeader
+ *   Input stream, one record per key transition:
+ *     varint  ticks since previous record (since tick 0 for the first)
+ *     uint8   key << 1 | pressed
+ *     varint  age of the transition within its tick, in subticks
+ *   Padding to 8 bytes
+ *   ReplayKeyframe array
+ *
+ * Varints are unsigned LEB128. A keyframe is taken every keyframe_interval
+ * pieces. Keyframes have a fixed size, so any of them is found without
+ * reading the ones before it, and playback continues from its snapshot
+ * instead of simulating from the start.
+ *
+ * Multi-byte fields are stored little endian, in the byte order of the
+ * platforms the game runs on.
+ */
+
+#define REPLAY_FORMAT_VERSION 1
+
+struct ReplayHeader {
+    char magic[4];
+    std::uint32_t format_version;
+    std::uint64_t seed;
+    GameSettings settings;
+    std::uint32_t keyframe_interval;
+    // Ticks run in total, playback stops after the last one.
+    std::uint64_t tick_count;
+    std::uint64_t input_offset;
+    std::uint64_t input_size;
+    std::uint64_t keyframe_offset;
+    std::uint64_t keyframe_count;
+};
+
+static_assert(88 == sizeof(ReplayHeader), "ReplayHeader layout is part of the replay format");
+
+struct ReplayKeyframe {
+    // Where decoding resumes, relative to input_offset, and the tick the
+    // record there is relative to.
+    std::uint64_t input_offset;
+    std::uint64_t input_base_tick;
+    GameSnapshot state;
+};
+
+static_assert(304 == sizeof(ReplayKeyframe), "ReplayKeyframe layout is part of the replay format");
+
+/*
+ * Builds a replay in memory while the game runs, written out once at the end.
+ * Inactive until started.
+ */
+class ReplayRecorder
+{
+public:
+    ReplayRecorder();
+
+    // Takes the first keyframe from game as it is.
+    void start(const Game& game, std::uint32_t keyframe_interval);
+
+    bool active() const { return m_active; }
+
+    // Before running the tick the transition is applied to.
+    void record_key(const Game& game, std::int32_t key, bool pressed, std::int32_t age);
+
+    // After running a tick.
+    void record_tick(const Game& game);
+
+    // Throws std::runtime_error when writing fails.
+    void write(const std::string& path) const;
+
+private:
+    void put_varint(std::uint64_t value);
+    void add_keyframe(const Game& game);
+
+    bool m_active;
+    struct ReplayHeader m_header;
+    std::vector<std::uint8_t> m_inputs;
+    std::vector<struct ReplayKeyframe> m_keyframes;
+    std::uint64_t m_last_tick;
+    std::uint64_t m_next_keyframe_pieces;
+};
+
+/*
+ * Plays back a replay file mapped into memory. Nothing is read up front
+ * besides the header, pages are faulted in as playback touches them.
+ */
+class ReplayPlayer
+{
+public:
+    ReplayPlayer();
+    ~ReplayPlayer();
+
+    ReplayPlayer(const ReplayPlayer&) = delete;
+    ReplayPlayer& operator=(const ReplayPlayer&) = delete;
+
+    // Throws std::runtime_error when the file can not be mapped or is invalid.
+    void open(const std::string& path);
+    void close();
+
+    bool is_open() const { return nullptr != m_data; }
+
+    const ReplayHeader& header() const { return *m_header; }
+    std::uint64_t keyframe_count() const { return m_header->keyframe_count; }
+    const ReplayKeyframe& keyframe(std::uint64_t i) const { return m_keyframes[i]; }
+
+    // Game created with the recorded settings and seed, at the first keyframe.
+    Game create_game();
+
+    /*
+     * Puts game into the state of keyframe i and continues playback from
+     * there. Throws std::runtime_error when the keyframe is invalid.
+     */
+    void seek(Game& game, std::uint64_t i);
+
+    /*
+     * Applies the transitions recorded for the tick game is about to run.
+     * Returns false when every recorded tick has been run.
+     */
+    bool apply(Game& game);
+
+private:
+    // Decodes the tick of the next record, or marks the end of the stream.
+    void read_next_tick();
+    std::uint64_t get_varint();
+
+    const std::uint8_t* m_data;
+    std::size_t m_size;
+
+    const ReplayHeader* m_header;
+    const std::uint8_t* m_inputs;
+    const ReplayKeyframe* m_keyframes;
+
+    std::uint64_t m_cursor;
+    std::uint64_t m_next_tick;
+};
+
+#endif // REPLAY_HPP_DEFINED
@@ -0,0 +1,48 @@
+#ifndef SCENE_HPP_DEFINED
+#define SCENE_HPP_DEFINED
+
+#include <cstdint>
+
+#include "Game.hpp"
+
+/*
+ * Everything on screen is drawn as blocks on a single grid, one instance per
+ * block. Grid origin is at bottom left.
+ */
+
+#define SCENE_WIDTH 22
+#define SCENE_HEIGHT 24
+#define SCENE_BOARD_X 6
+#define SCENE_BOARD_Y 1
+#define SCENE_BOARD_ROWS (BOARD_VISIBLE_HEIGHT + 2)
+#define SCENE_HOLD_X 0
+#define SCENE_HOLD_Y 18
+#define SCENE_NEXT_X 18
+#define SCENE_NEXT_Y 18
+#define SCENE_NEXT_SPACING 3
+
+#define SCENE_COLOUR_WALL 7
+#define SCENE_FLAG_GHOST 1
+
+// Enough for a completely filled board along with every other element.
+#define SCENE_MAX_INSTANCES 1024
+
+constexpr std::uint32_t
+scene_pack_block(
+        std::uint32_t column,
+        std::uint32_t row,
+        std::uint32_t colour,
+        std::uint32_t flags)
+{
+    return (column & 0xFF) | ((row & 0xFF) << 8) |
+        ((colour & 0xFF) << 16) | ((flags & 0xFF) << 24);
+}
+
+/*
+ * Writes blocks of the board, walls, ghost, active piece, hold and next queue
+ * to instances, which must have room for SCENE_MAX_INSTANCES. Returns the
+ * amount of blocks written.
+ */
+std::uint32_t scene_build_instances(const Game& game, std::uint32_t* instances);
+
+#endif // SCENE_HPP_DEFINED
@@ -0,0 +1,20 @@
+#ifndef SHADERS_HPP_DEFINED
+#define SHADERS_HPP_DEFINED
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * SPIR-V of the shaders under shaders/, compiled by the Makefile and linked
+ * into the executable, so that nothing needs to be read from disk at startup.
+ */
+struct ShaderCode {
+    const std::uint32_t* words;
+    // In bytes, as expected by VkShaderModuleCreateInfo.
+    std::size_t size;
+};
+
+extern const ShaderCode g_shader_code_vert;
+extern const ShaderCode g_shader_code_frag;
+
+#endif // SHADERS_HPP_DEFINED
@@ -0,0 +1,42 @@
+#ifndef STARTUP_PROFILER_HPP_DEFINED
+#define STARTUP_PROFILER_HPP_DEFINED
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+/*
+ * Wall time of each startup phase, measured from construction to the first
+ * presented frame. Each mark() closes the phase which started at the previous
+ * mark.
+ */
+class StartupProfiler
+{
+public:
+    StartupProfiler();
+
+    void mark(const std::string& phase);
+
+    // Closes the last phase, only the first call has an effect.
+    void mark_first_frame();
+
+    bool first_frame_done() const { return m_first_frame_done; }
+    std::chrono::steady_clock::duration time_to_first_frame() const;
+
+    // Writes the breakdown table through Log.
+    void report() const;
+
+private:
+    struct Phase {
+        std::string name;
+        std::chrono::steady_clock::duration duration;
+    };
+
+    std::chrono::steady_clock::time_point m_start;
+    std::chrono::steady_clock::time_point m_previous;
+    std::chrono::steady_clock::time_point m_first_frame;
+    bool m_first_frame_done;
+    std::vector<Phase> m_phases;
+};
+
+#endif // STARTUP_PROFILER_HPP_DEFINED
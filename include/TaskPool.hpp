@@ -0,0 +1,89 @@
+#ifndef TASK_POOL_HPP_DEFINED
+#define TASK_POOL_HPP_DEFINED
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed set of worker threads running parallel loops. A loop is split into
+ * chunks of consecutive indices, dealt round robin onto per-worker queues.
+ * Each worker takes chunks from the back of its own queue and, once that
+ * runs dry, steals from the front of the others, so that uneven chunks even
+ * out without a shared queue everyone contends on.
+ *
+ * Calling thread takes part in its loops as worker 0. Loops run one at a
+ * time and must not be started from within a loop body.
+ */
+
+#define TASK_POOL_MAX_THREADS 64
+#define TASK_POOL_CHUNKS_PER_THREAD 8
+
+typedef void (*TaskFunction)(void* context, std::uint32_t index, std::int32_t worker);
+
+class TaskPool
+{
+public:
+    TaskPool();
+    ~TaskPool();
+
+    // thread_count includes the caller, zero picks one per hardware thread.
+    void start(std::int32_t thread_count);
+    void stop();
+
+    // Including the caller, one until started.
+    std::int32_t thread_count() const { return m_thread_count; }
+
+    // Calls body(index, worker) for every index below count, returning once
+    // all calls have returned.
+    template<typename F>
+    void parallel_for(std::uint32_t count, F& body)
+    {
+        run(count, &call<F>, &body);
+    }
+
+private:
+    struct TaskRange {
+        std::uint32_t begin;
+        std::uint32_t end;
+    };
+
+    struct alignas(64) WorkerQueue {
+        std::mutex mutex;
+        std::array<TaskRange, TASK_POOL_CHUNKS_PER_THREAD> ranges;
+        // Thieves take from head, the owner from tail.
+        std::uint32_t head;
+        std::uint32_t tail;
+    };
+
+    template<typename F>
+    static void call(void* context, std::uint32_t index, std::int32_t worker)
+    {
+        (*static_cast<F*>(context))(index, worker);
+    }
+
+    void run(std::uint32_t count, TaskFunction function, void* context);
+    bool run_one(std::int32_t worker);
+    void work(std::int32_t worker);
+
+    std::int32_t m_thread_count;
+    std::vector<std::thread> m_threads;
+    std::array<WorkerQueue, TASK_POOL_MAX_THREADS> m_queues;
+
+    TaskFunction m_function;
+    void* m_context;
+
+    // Chunks not yet finished in the running loop.
+    alignas(64) std::atomic<std::uint32_t> m_remaining;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::uint64_t m_generation;
+    bool m_stopping;
+};
+
+#endif // TASK_POOL_HPP_DEFINED
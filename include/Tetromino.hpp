@@ -0,0 +1,239 @@
+#ifndef TETROMINO_HPP_DEFINED
+#define TETROMINO_HPP_DEFINED
+
+#include <array>
+#include <cstdint>
+
+#include "Board.hpp"
+
+/*
+ * Rotation states and SRS wall kicks of all tetrominoes. Everything here is
+ * evaluated at compile time, so that rotating is a matter of table lookups
+ * followed by bitboard collision checks.
+ */
+
+#define TETROMINO_ROTATION_COUNT 4
+#define TETROMINO_KICK_COUNT 5
+#define TETROMINO_SPAWN_X 3
+
+enum Tetromino {
+    TETROMINO_I = 0,
+    TETROMINO_J,
+    TETROMINO_L,
+    TETROMINO_O,
+    TETROMINO_S,
+    TETROMINO_T,
+    TETROMINO_Z,
+    TETROMINO_COUNT,
+};
+
+enum Rotation {
+    ROTATION_SPAWN = 0,
+    ROTATION_RIGHT,
+    ROTATION_180,
+    ROTATION_LEFT,
+};
+
+enum RotationDirection {
+    ROTATE_CW = 0,
+    ROTATE_CCW,
+    ROTATE_DIRECTION_COUNT,
+};
+
+struct Kick {
+    std::int8_t x;
+    std::int8_t y;
+};
+
+typedef std::array<PieceRows, TETROMINO_ROTATION_COUNT> TetrominoRotations;
+typedef std::array<std::array<std::array<Kick, TETROMINO_KICK_COUNT>,
+        ROTATE_DIRECTION_COUNT>, TETROMINO_ROTATION_COUNT> KickTable;
+
+namespace tetromino_detail {
+
+struct SpawnShape {
+    std::int32_t box;
+    bool rotates;
+    // Spawn orientation, top row first.
+    const char* cells[BOARD_PIECE_ROWS];
+};
+
+constexpr SpawnShape g_spawn_shapes[TETROMINO_COUNT] = {
+    { 4, true,  { "....", "####", "....", "...." } },
+    { 3, true,  { "#..",  "###",  "...",  ""     } },
+    { 3, true,  { "..#",  "###",  "...",  ""     } },
+    { 3, false, { ".##",  ".##",  "...",  ""     } },
+    { 3, true,  { ".##",  "##.",  "...",  ""     } },
+    { 3, true,  { ".#.",  "###",  "...",  ""     } },
+    { 3, true,  { "##.",  ".##",  "...",  ""     } },
+};
+
+constexpr PieceRows
+parse_spawn(const SpawnShape& shape)
+{
+    PieceRows piece = {};
+
+    for (std::int32_t row = 0; row < shape.box; row++) {
+        for (std::int32_t column = 0; column < shape.box; column++) {
+            if ('#' == shape.cells[row][column]) {
+                piece.rows[shape.box - 1 - row] |= 1u << column;
+            }
+        }
+    }
+
+    return piece;
+}
+
+// Clockwise rotation within the piece box, cell (c, r) moves to (r, box - 1 - c).
+constexpr PieceRows
+rotate_cw(const PieceRows& piece, std::int32_t box)
+{
+    PieceRows rotated = {};
+
+    for (std::int32_t row = 0; row < box; row++) {
+        for (std::int32_t column = 0; column < box; column++) {
+            if (piece.rows[row] & (1u << column)) {
+                rotated.rows[box - 1 - column] |= 1u << row;
+            }
+        }
+    }
+
+    return rotated;
+}
+
+constexpr TetrominoRotations
+make_rotations(const SpawnShape& shape)
+{
+    TetrominoRotations rotations = {};
+
+    rotations[0] = parse_spawn(shape);
+    for (std::int32_t i = 1; i < TETROMINO_ROTATION_COUNT; i++) {
+        rotations[i] = shape.rotates ?
+            rotate_cw(rotations[i - 1], shape.box) :
+            rotations[i - 1];
+    }
+
+    return rotations;
+}
+
+constexpr std::array<TetrominoRotations, TETROMINO_COUNT>
+make_rotation_table()
+{
+    std::array<TetrominoRotations, TETROMINO_COUNT> table = {};
+
+    for (std::int32_t i = 0; i < TETROMINO_COUNT; i++) {
+        table[i] = make_rotations(g_spawn_shapes[i]);
+    }
+
+    return table;
+}
+
+// SRS kicks, indexed by [from rotation][direction][attempt]. y grows upwards.
+constexpr KickTable g_kicks_jlstz = {{
+    {{ {{ {0, 0}, {-1, 0}, {-1,  1}, {0, -2}, {-1, -2} }},     // 0 -> R
+       {{ {0, 0}, { 1, 0}, { 1,  1}, {0, -2}, { 1, -2} }} }},  // 0 -> L
+    {{ {{ {0, 0}, { 1, 0}, { 1, -1}, {0,  2}, { 1,  2} }},     // R -> 2
+       {{ {0, 0}, { 1, 0}, { 1, -1}, {0,  2}, { 1,  2} }} }},  // R -> 0
+    {{ {{ {0, 0}, { 1, 0}, { 1,  1}, {0, -2}, { 1, -2} }},     // 2 -> L
+       {{ {0, 0}, {-1, 0}, {-1,  1}, {0, -2}, {-1, -2} }} }},  // 2 -> R
+    {{ {{ {0, 0}, {-1, 0}, {-1, -1}, {0,  2}, {-1,  2} }},     // L -> 0
+       {{ {0, 0}, {-1, 0}, {-1, -1}, {0,  2}, {-1,  2} }} }},  // L -> 2
+}};
+
+constexpr KickTable g_kicks_i = {{
+    {{ {{ {0, 0}, {-2, 0}, { 1, 0}, {-2, -1}, { 1,  2} }},     // 0 -> R
+       {{ {0, 0}, {-1, 0}, { 2, 0}, {-1,  2}, { 2, -1} }} }},  // 0 -> L
+    {{ {{ {0, 0}, {-1, 0}, { 2, 0}, {-1,  2}, { 2, -1} }},     // R -> 2
+       {{ {0, 0}, { 2, 0}, {-1, 0}, { 2,  1}, {-1, -2} }} }},  // R -> 0
+    {{ {{ {0, 0}, { 2, 0}, {-1, 0}, { 2,  1}, {-1, -2} }},     // 2 -> L
+       {{ {0, 0}, { 1, 0}, {-2, 0}, { 1, -2}, {-2,  1} }} }},  // 2 -> R
+    {{ {{ {0, 0}, { 1, 0}, {-2, 0}, { 1, -2}, {-2,  1} }},     // L -> 0
+       {{ {0, 0}, {-2, 0}, { 1, 0}, {-2, -1}, { 1,  2} }} }},  // L -> 2
+}};
+
+// O piece does not move when rotated, only the first attempt is meaningful.
+constexpr KickTable g_kicks_none = {};
+
+constexpr std::array<KickTable, TETROMINO_COUNT>
+make_kick_table()
+{
+    std::array<KickTable, TETROMINO_COUNT> table = {};
+
+    for (std::int32_t i = 0; i < TETROMINO_COUNT; i++) {
+        table[i] =
+            TETROMINO_I == i ? g_kicks_i :
+            TETROMINO_O == i ? g_kicks_none :
+            g_kicks_jlstz;
+    }
+
+    return table;
+}
+
+} // namespace tetromino_detail
+
+constexpr std::array<TetrominoRotations, TETROMINO_COUNT> g_tetromino_rotations =
+    tetromino_detail::make_rotation_table();
+
+constexpr std::array<KickTable, TETROMINO_COUNT> g_tetromino_kicks =
+    tetromino_detail::make_kick_table();
+
+// Spawn row of the piece box, so that pieces appear right above the visible area.
+constexpr std::int32_t g_tetromino_spawn_y[TETROMINO_COUNT] = {
+    BOARD_VISIBLE_HEIGHT - 2,
+    BOARD_VISIBLE_HEIGHT - 1,
+    BOARD_VISIBLE_HEIGHT - 1,
+    BOARD_VISIBLE_HEIGHT - 1,
+    BOARD_VISIBLE_HEIGHT - 1,
+    BOARD_VISIBLE_HEIGHT - 1,
+    BOARD_VISIBLE_HEIGHT - 1,
+};
+
+static_assert(0x0F == g_tetromino_rotations[TETROMINO_I][ROTATION_SPAWN].rows[2],
+        "I spawn state");
+static_assert(0x04 == g_tetromino_rotations[TETROMINO_I][ROTATION_RIGHT].rows[0],
+        "I right state");
+static_assert(0x02 == g_tetromino_rotations[TETROMINO_T][ROTATION_180].rows[0],
+        "T 180 state");
+
+constexpr const PieceRows&
+tetromino_rows(std::int32_t type, std::int32_t rotation)
+{
+    return g_tetromino_rotations[type][rotation];
+}
+
+/*
+ * Attempts to rotate a piece in place, trying SRS kicks in order. On success
+ * rotation, x and y are updated and the index of the kick used is returned.
+ * Returns -1 when every kick collides, leaving the piece untouched.
+ */
+inline std::int32_t
+tetromino_rotate(
+        const Board& board,
+        std::int32_t type,
+        std::int32_t direction,
+        std::int32_t& rotation,
+        std::int32_t& x,
+        std::int32_t& y)
+{
+    std::int32_t target;
+
+    const PieceRows* piece;
+    const std::array<Kick, TETROMINO_KICK_COUNT>* kicks;
+
+    target = (rotation + (ROTATE_CW == direction ? 1 : 3)) & 3;
+    piece = &g_tetromino_rotations[type][target];
+    kicks = &g_tetromino_kicks[type][rotation][direction];
+
+    for (std::int32_t i = 0; i < TETROMINO_KICK_COUNT; i++) {
+        if ( ! board.collides(*piece, x + (*kicks)[i].x, y + (*kicks)[i].y)) {
+            rotation = target;
+            x += (*kicks)[i].x;
+            y += (*kicks)[i].y;
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+#endif // TETROMINO_HPP_DEFINED
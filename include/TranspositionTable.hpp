@@ -0,0 +1,93 @@
+#ifndef TRANSPOSITION_TABLE_HPP_DEFINED
+#define TRANSPOSITION_TABLE_HPP_DEFINED
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Fixed size hash table from 64-bit position hashes to 64-bit values, shared
+ * by search threads without locks. Entries are grouped four to a cache line
+ * and a hash picks the line, so a probe touches one line.
+ *
+ * An entry is two words written one after the other, the hash xored with
+ * the value and the value. Racing writers can leave an entry with words from
+ * different stores. The xor then no longer gives back the hash, so the torn
+ * entry reads as a miss rather than as a wrong value.
+ *
+ * Entries get overwritten when a line is full, so a stored value may be
+ * gone by the time it is probed.
+ */
+
+#define TRANSPOSITION_TABLE_WAYS 4
+
+class TranspositionTable
+{
+public:
+    TranspositionTable();
+
+    // 2^bits lines of 64 bytes, zero bits frees the table and disables it.
+    void resize(std::int32_t bits);
+    void clear();
+
+    bool enabled() const { return ! m_lines.empty(); }
+
+    bool probe(std::uint64_t hash, std::uint64_t& value) const
+    {
+        std::uint64_t check;
+        std::uint64_t stored;
+
+        const Line& line = m_lines[hash & m_mask];
+
+        for (const Entry& entry : line.entries) {
+            check = entry.check.load(std::memory_order_relaxed);
+            stored = entry.value.load(std::memory_order_relaxed);
+            if ((check ^ stored) == hash) {
+                value = stored;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void store(std::uint64_t hash, std::uint64_t value)
+    {
+        std::uint64_t check;
+        std::uint64_t stored;
+        std::uint32_t way;
+
+        Line& line = m_lines[hash & m_mask];
+
+        // Same hash or an empty entry, otherwise one picked by the hash.
+        way = static_cast<std::uint32_t>(hash >> 62) % TRANSPOSITION_TABLE_WAYS;
+        for (std::uint32_t i = 0; i < TRANSPOSITION_TABLE_WAYS; i++) {
+            check = line.entries[i].check.load(std::memory_order_relaxed);
+            stored = line.entries[i].value.load(std::memory_order_relaxed);
+            if ((check ^ stored) == hash || (0 == check && 0 == stored)) {
+                way = i;
+                break;
+            }
+        }
+
+        line.entries[way].check.store(hash ^ value, std::memory_order_relaxed);
+        line.entries[way].value.store(value, std::memory_order_relaxed);
+    }
+
+private:
+    struct Entry {
+        std::atomic<std::uint64_t> check;
+        std::atomic<std::uint64_t> value;
+    };
+
+    struct alignas(64) Line {
+        Entry entries[TRANSPOSITION_TABLE_WAYS];
+    };
+
+    static_assert(64 == sizeof(Line), "Line fills a cache line");
+
+    std::vector<Line> m_lines;
+    std::uint64_t m_mask;
+};
+
+#endif // TRANSPOSITION_TABLE_HPP_DEFINED
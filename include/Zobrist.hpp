@@ -0,0 +1,99 @@
+#ifndef ZOBRIST_HPP_DEFINED
+#define ZOBRIST_HPP_DEFINED
+
+#include <array>
+#include <cstdint>
+
+#include "Board.hpp"
+#include "Tetromino.hpp"
+
+/*
+ * Zobrist hashing of search positions. Every filled cell, the held piece
+ * and the position within the piece sequence each have a random key, and a
+ * position hashes to the xor of its keys. Placing a piece updates the hash
+ * with the keys of the four cells it fills. Clearing lines moves rows, so
+ * the board is hashed again from scratch after that.
+ *
+ * Keys are generated at compile time with splitmix64 from a fixed seed, so
+ * hashes are the same from run to run.
+ */
+
+// Pieces are told apart by their number in the sequence modulo this.
+#define ZOBRIST_SEQUENCE_LENGTH 64 // Power of two
+
+struct ZobristKeys {
+    std::array<std::array<std::uint64_t, BOARD_WIDTH>, BOARD_HEIGHT> cells;
+    // Held type + 1, zero for nothing held.
+    std::array<std::uint64_t, TETROMINO_COUNT + 1> hold;
+    std::array<std::uint64_t, ZOBRIST_SEQUENCE_LENGTH> sequence;
+};
+
+namespace zobrist_detail {
+
+constexpr std::uint64_t
+splitmix64(std::uint64_t& state)
+{
+    std::uint64_t z = 0;
+
+    state += 0x9E3779B97F4A7C15ull;
+    z = state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+
+    return z ^ (z >> 31);
+}
+
+constexpr ZobristKeys
+make_keys()
+{
+    ZobristKeys keys = {};
+    std::uint64_t state = 0x6E656F7465747269ull;
+
+    for (auto& row : keys.cells) {
+        for (std::uint64_t& key : row) {
+            key = splitmix64(state);
+        }
+    }
+    for (std::uint64_t& key : keys.hold) {
+        key = splitmix64(state);
+    }
+    for (std::uint64_t& key : keys.sequence) {
+        key = splitmix64(state);
+    }
+
+    return keys;
+}
+
+} // namespace zobrist_detail
+
+constexpr ZobristKeys g_zobrist_keys = zobrist_detail::make_keys();
+
+std::uint64_t zobrist_board(const Board& board);
+
+// Hash of board after placing piece on it, given the hash before. Placement
+// must not clear lines.
+inline std::uint64_t
+zobrist_place(std::uint64_t hash, const PieceRows& piece, std::int32_t x, std::int32_t y)
+{
+    std::uint32_t cells;
+
+    for (std::int32_t i = 0; i < BOARD_PIECE_ROWS; i++) {
+        cells = piece.rows[i];
+        while (cells) {
+            hash ^= g_zobrist_keys.cells[y + i][x + __builtin_ctz(cells)];
+            cells &= cells - 1;
+        }
+    }
+
+    return hash;
+}
+
+// Adds the held type, -1 for nothing, and the number of the next piece.
+inline std::uint64_t
+zobrist_position(std::uint64_t board_hash, std::int32_t hold, std::uint64_t sequence)
+{
+    return board_hash ^ g_zobrist_keys.hold[hold + 1] ^
+        g_zobrist_keys.sequence[sequence & (ZOBRIST_SEQUENCE_LENGTH - 1)];
+}
+
+#endif // ZOBRIST_HPP_DEFINED
@@ -1,7 +1,29 @@
 #version 450
 
+layout(location = 0) flat in uint in_colour;
+layout(location = 1) flat in uint in_flags;
+
 layout(location = 0) out vec4 outColor;
 
+// Indexed by tetromino type, followed by wall colour.
+const vec3 palette[8] = vec3[](
+    vec3(0.0, 0.9, 0.9),
+    vec3(0.1, 0.2, 0.9),
+    vec3(0.9, 0.5, 0.0),
+    vec3(0.9, 0.9, 0.0),
+    vec3(0.1, 0.8, 0.1),
+    vec3(0.6, 0.1, 0.8),
+    vec3(0.9, 0.1, 0.1),
+    vec3(0.3, 0.3, 0.3)
+);
+
 void main() {
-    outColor = vec4(1.0, 0.0, 0.0, 1.0);
+    vec3 color = palette[in_colour & 7u];
+
+    // Ghost piece
+    if (0u != (in_flags & 1u)) {
+        color *= 0.3;
+    }
+
+    outColor = vec4(color, 1.0);
 }
@@ -1,11 +1,34 @@
 #version 450
 
-vec2 positions[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
+// Block packed as column (bits 0-7), row (8-15), colour (16-23), flags (24-31)
+layout(location = 0) in uint in_block;
+
+layout(push_constant) uniform SceneTransform {
+    vec2 scale;
+    vec2 offset;
+} scene;
+
+layout(location = 0) flat out uint out_colour;
+layout(location = 1) flat out uint out_flags;
+
+// Unit quad drawn as a triangle strip, slightly inset to leave a grid gap.
+vec2 corners[4] = vec2[](
+    vec2(0.05, 0.05),
+    vec2(0.95, 0.05),
+    vec2(0.05, 0.95),
+    vec2(0.95, 0.95)
 );
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
+    vec2 cell = vec2(
+        float(in_block & 0xFFu),
+        float((in_block >> 8) & 0xFFu));
+
+    gl_Position = vec4(
+        (cell + corners[gl_VertexIndex]) * scene.scale + scene.offset,
+        0.0,
+        1.0);
+
+    out_colour = (in_block >> 16) & 0xFFu;
+    out_flags = in_block >> 24;
 }
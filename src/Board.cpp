@@ -0,0 +1,62 @@
+#include "Board.hpp"
+
+Board::Board()
+{
+    clear();
+}
+
+void Board::clear()
+{
+    std::int32_t i;
+
+    for (i = 0; i < BOARD_FLOOR_ROWS; i++) {
+        m_rows[i] = g_board_row_full;
+    }
+
+    for (; i < BOARD_FLOOR_ROWS + BOARD_HEIGHT; i++) {
+        m_rows[i] = g_board_row_empty;
+    }
+
+    for (; i < static_cast<std::int32_t>(m_rows.size()); i++) {
+        m_rows[i] = g_board_row_full;
+    }
+}
+
+std::int32_t Board::clear_lines()
+{
+    std::int32_t read;
+    std::int32_t write;
+    std::int32_t end;
+    BoardRow row;
+
+    // Ceiling rows are full as well, but are not part of the playfield.
+    end = BOARD_FLOOR_ROWS + BOARD_HEIGHT;
+    write = BOARD_FLOOR_ROWS;
+
+    // Compact non-full rows downwards without branching on row contents.
+    for (read = BOARD_FLOOR_ROWS; read < end; read++) {
+        row = m_rows[read];
+        m_rows[write] = row;
+        write += (g_board_row_full != row);
+    }
+
+    for (read = write; read < end; read++) {
+        m_rows[read] = g_board_row_empty;
+    }
+
+    return end - write;
+}
+
+std::uint64_t Board::full_rows() const
+{
+    std::uint64_t full;
+
+    full = 0;
+
+    for (std::int32_t i = 0; i < BOARD_HEIGHT; i++) {
+        full |= static_cast<std::uint64_t>(
+                g_board_row_full == m_rows[i + BOARD_FLOOR_ROWS]) << i;
+    }
+
+    return full;
+}
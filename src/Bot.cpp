@@ -0,0 +1,552 @@
+#include "Bot.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "Replay.hpp"
+#include "Tetromino.hpp"
+#include "Zobrist.hpp"
+
+// Reward of clearing 0 .. 4 lines at once. Small clears are discouraged, so
+// that the stack gets built up for bigger ones.
+static const float g_line_rewards[5] = { 0.0f, -1.5f, -1.0f, -0.5f, 8.0f };
+// Reward of a T spin clearing 0 .. 3 lines.
+static const float g_t_spin_rewards[4] = { 0.0f, 2.0f, 7.0f, 10.0f };
+// Score of a board on which the next piece can not spawn.
+static const float g_top_out_score = -1.0e6f;
+
+// Keys the path to a placement is made of, in order of preference.
+static const std::int32_t g_path_keys[] = {
+    GAME_KEY_LEFT,
+    GAME_KEY_RIGHT,
+    GAME_KEY_ROTATE_CW,
+    GAME_KEY_ROTATE_CCW,
+    GAME_KEY_SOFT_DROP,
+};
+
+static inline std::uint32_t
+path_state(std::int32_t rotation, std::int32_t x, std::int32_t y)
+{
+    return (static_cast<std::uint32_t>(rotation) * 16 + (x + BOARD_WALL_LEFT)) *
+        MOVE_GENERATOR_ROWS + (y + BOARD_FLOOR_ROWS);
+}
+
+/*
+ * T locked immobile with three of the four corners around its centre filled.
+ * Whether the last move was a rotation is not known here, a piece which can
+ * not move up got there by one almost always.
+ */
+static bool
+is_t_spin(const Board& board, const Placement& placement)
+{
+    std::int32_t x;
+    std::int32_t y;
+    std::int32_t corners;
+
+    x = placement.x;
+    y = placement.y;
+
+    if ( ! board.collides(tetromino_rows(TETROMINO_T, placement.rotation), x, y + 1)) {
+        return false;
+    }
+
+    corners = board.cell(x, y) + board.cell(x + 2, y) +
+        board.cell(x, y + 2) + board.cell(x + 2, y + 2);
+
+    return corners >= 3;
+}
+
+Bot::Bot() :
+    m_settings(default_settings()),
+    m_active(false),
+    m_kernel(EVALUATOR_KERNEL_SCALAR),
+    m_piece_count(0),
+    m_depth(0),
+    m_root_hold(false),
+    m_expired(false),
+    m_planned(false),
+    m_decisions(0),
+    m_plan_pieces(0),
+    m_hold_pending(false),
+    m_keys_down(0)
+{
+    m_decision = {};
+}
+
+BotSettings Bot::default_settings()
+{
+    BotSettings settings;
+
+    settings = {};
+
+    settings.beam_width = 128;
+    // Leaves most of a tick for drawing the frame.
+    settings.budget = std::chrono::milliseconds(5);
+    settings.thread_count = 0;
+    // 4 MiB
+    settings.table_bits = 16;
+    settings.weights = evaluator_default_weights();
+
+    return settings;
+}
+
+void Bot::start(const BotSettings& settings)
+{
+    m_settings = settings;
+    m_settings.beam_width = std::max(m_settings.beam_width, 1);
+
+    m_kernel = evaluator_detect_kernel();
+
+    m_pool.start(m_settings.thread_count);
+    m_workers.resize(m_pool.thread_count());
+    for (Worker& worker : m_workers) {
+        worker.boards.resize(MOVE_GENERATOR_MAX_PLACEMENTS);
+        worker.features.resize(MOVE_GENERATOR_MAX_PLACEMENTS);
+        worker.misses.resize(MOVE_GENERATOR_MAX_PLACEMENTS);
+        worker.miss_hashes.resize(MOVE_GENERATOR_MAX_PLACEMENTS);
+    }
+
+    m_table.resize(m_settings.table_bits);
+
+    m_active = true;
+    m_planned = false;
+    m_decisions = 0;
+    m_hold_pending = false;
+    m_keys_down = 0;
+}
+
+void Bot::stop()
+{
+    m_pool.stop();
+    m_workers.clear();
+    m_table.resize(0);
+    m_active = false;
+}
+
+BotDecision Bot::decide(const Game& game)
+{
+    Node root;
+    std::uint32_t kept;
+    std::chrono::steady_clock::time_point start;
+
+    auto body = [this](std::uint32_t index, std::int32_t worker) {
+        expand(index, worker);
+    };
+
+    start = std::chrono::steady_clock::now();
+    m_deadline = start + m_settings.budget;
+    m_expired.store(false, std::memory_order_relaxed);
+
+    m_pieces[0] = static_cast<std::int8_t>(game.piece().type);
+    for (std::int32_t i = 0; i < GAME_NEXT_QUEUE_LENGTH; i++) {
+        m_pieces[i + 1] = static_cast<std::int8_t>(game.next(i));
+    }
+    m_piece_count = BOT_MAX_PIECES;
+    // Current piece has been taken already.
+    m_sequence = game.pieces() - 1;
+    m_start = game.piece();
+    m_root_hold = ! game.hold_used();
+
+    root.board = game.board();
+    root.hash = zobrist_board(root.board);
+    root.reward = 0.0f;
+    root.hold = static_cast<std::int8_t>(game.hold());
+    root.queue = 0;
+    root.root = 0;
+
+    m_beam.clear();
+    m_beam.push_back(root);
+    m_roots.clear();
+
+    m_decision = {};
+    m_decision.type = m_start.type;
+    m_decision.placement.rotation = static_cast<std::int8_t>(m_start.rotation);
+    m_decision.placement.x = static_cast<std::int8_t>(m_start.x);
+    m_decision.placement.y = static_cast<std::int8_t>(game.ghost_y());
+
+    for (Worker& worker : m_workers) {
+        worker.nodes = 0;
+        worker.table_hits = 0;
+    }
+
+    for (m_depth = 0; m_depth < m_piece_count && ! m_beam.empty(); m_depth++) {
+        for (Worker& worker : m_workers) {
+            worker.candidates.clear();
+        }
+
+        m_pool.parallel_for(static_cast<std::uint32_t>(m_beam.size()), body);
+
+        // Unfinished layer would favour whichever nodes got expanded first.
+        if (m_depth > 0 && m_expired.load(std::memory_order_relaxed)) {
+            break;
+        }
+
+        m_candidates.clear();
+        for (Worker& worker : m_workers) {
+            m_candidates.insert(
+                    m_candidates.end(),
+                    worker.candidates.begin(),
+                    worker.candidates.end());
+        }
+
+        if (m_candidates.empty()) {
+            break;
+        }
+
+        if (0 == m_depth) {
+            for (std::uint32_t i = 0; i < m_candidates.size(); i++) {
+                m_candidates[i].root = static_cast<std::uint16_t>(i);
+            }
+            m_roots = m_candidates;
+        }
+
+        kept = std::min<std::uint32_t>(m_candidates.size(), m_settings.beam_width);
+        std::partial_sort(
+                m_candidates.begin(),
+                m_candidates.begin() + kept,
+                m_candidates.end(),
+                [](const Candidate& a, const Candidate& b) {
+                    return a.score > b.score;
+                });
+
+        const Candidate& best = m_roots[m_candidates[0].root];
+        m_decision.hold = best.used_hold;
+        m_decision.type = best.type;
+        m_decision.placement = best.placement;
+        m_decision.depth = m_depth + 1;
+
+        // Boards are rebuilt only for the candidates kept.
+        m_next_beam.resize(kept);
+        for (std::uint32_t i = 0; i < kept; i++) {
+            const Candidate& candidate = m_candidates[i];
+            Node& node = m_next_beam[i];
+
+            node.board = m_beam[candidate.parent].board;
+            node.board.place(
+                    tetromino_rows(candidate.type, candidate.placement.rotation),
+                    candidate.placement.x,
+                    candidate.placement.y);
+            node.board.clear_lines();
+            node.hash = candidate.hash;
+            node.reward = candidate.reward;
+            node.hold = candidate.hold;
+            node.queue = candidate.queue;
+            node.root = candidate.root;
+        }
+
+        // Lines which topped out or ran out of pieces go no further.
+        m_next_beam.erase(
+                std::remove_if(
+                    m_next_beam.begin(),
+                    m_next_beam.end(),
+                    [this](const Node& node) { return node.queue >= m_piece_count; }),
+                m_next_beam.end());
+
+        m_beam.swap(m_next_beam);
+    }
+
+    for (const Worker& worker : m_workers) {
+        m_decision.nodes += worker.nodes;
+        m_decision.table_hits += worker.table_hits;
+    }
+    m_decisions++;
+
+    return m_decision;
+}
+
+void Bot::expand(std::uint32_t index, std::int32_t worker_index)
+{
+    std::int32_t type;
+    std::int32_t held;
+    ActivePiece start;
+
+    Worker& worker = m_workers[worker_index];
+    const Node& node = m_beam[index];
+
+    if (m_depth > 0) {
+        if (m_expired.load(std::memory_order_relaxed)) {
+            return;
+        }
+        if (std::chrono::steady_clock::now() >= m_deadline) {
+            m_expired.store(true, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    type = m_pieces[node.queue];
+    start = 0 == m_depth ? m_start : MoveGenerator::spawn(type);
+
+    expand_piece(worker, index, start, node.hold, node.queue + 1, false);
+
+    if (0 == m_depth && ! m_root_hold) {
+        return;
+    }
+
+    held = node.hold;
+    if (type == held) {
+        return;
+    }
+
+    if (held >= 0) {
+        expand_piece(worker, index, MoveGenerator::spawn(held), type, node.queue + 1, true);
+    } else if (node.queue + 1 < m_piece_count) {
+        expand_piece(
+                worker,
+                index,
+                MoveGenerator::spawn(m_pieces[node.queue + 1]),
+                type,
+                node.queue + 2,
+                true);
+    }
+}
+
+void Bot::expand_piece(
+        Worker& worker,
+        std::uint32_t index,
+        const ActivePiece& start,
+        std::int32_t hold,
+        std::int32_t queue,
+        bool used_hold)
+{
+    std::uint32_t count;
+    std::uint32_t missed;
+    std::int32_t lines;
+    std::int32_t next;
+    std::uint64_t position;
+    std::uint64_t value;
+    std::uint32_t bits;
+    float reward;
+    float evaluation;
+    bool t_spin;
+    Candidate candidate;
+
+    const Node& node = m_beam[index];
+
+    count = worker.generator.generate(node.board, start, worker.placements);
+    missed = 0;
+
+    // Boards missing from the table are evaluated in one batch once all of
+    // them are placed.
+    for (std::uint32_t i = 0; i < count; i++) {
+        const Placement& placement = worker.placements.placements[i];
+        const PieceRows& rows = tetromino_rows(start.type, placement.rotation);
+        Board& board = worker.boards[missed];
+
+        t_spin = TETROMINO_T == start.type && is_t_spin(node.board, placement);
+
+        board = node.board;
+        board.place(rows, placement.x, placement.y);
+        lines = board.clear_lines();
+
+        reward = node.reward + (t_spin ? g_t_spin_rewards[lines] : g_line_rewards[lines]);
+
+        candidate.hash = 0 == lines ?
+            zobrist_place(node.hash, rows, placement.x, placement.y) :
+            zobrist_board(board);
+        candidate.reward = reward;
+        candidate.score = reward;
+        candidate.parent = index;
+        candidate.root = node.root;
+        candidate.placement = placement;
+        candidate.type = static_cast<std::int8_t>(start.type);
+        candidate.hold = static_cast<std::int8_t>(hold);
+        candidate.queue = static_cast<std::uint8_t>(queue);
+        candidate.used_hold = used_hold;
+
+        if (queue < m_piece_count) {
+            next = m_pieces[queue];
+            if (board.collides(tetromino_rows(next, ROTATION_SPAWN),
+                        TETROMINO_SPAWN_X, g_tetromino_spawn_y[next])) {
+                candidate.score += g_top_out_score;
+                candidate.queue = static_cast<std::uint8_t>(m_piece_count);
+            }
+        }
+
+        position = zobrist_position(candidate.hash, hold, m_sequence + queue);
+        if (m_table.enabled() && m_table.probe(position, value)) {
+            bits = static_cast<std::uint32_t>(value);
+            std::memcpy(&evaluation, &bits, sizeof(evaluation));
+            candidate.score += evaluation;
+            worker.table_hits++;
+        } else {
+            worker.misses[missed] = static_cast<std::uint32_t>(worker.candidates.size());
+            worker.miss_hashes[missed] = position;
+            missed++;
+        }
+
+        worker.candidates.push_back(candidate);
+    }
+
+    evaluator_features_batch(m_kernel, worker.boards.data(), missed, worker.features.data());
+
+    for (std::uint32_t i = 0; i < missed; i++) {
+        evaluation = evaluator_score(worker.features[i], m_settings.weights);
+        worker.candidates[worker.misses[i]].score += evaluation;
+
+        if (m_table.enabled()) {
+            std::memcpy(&bits, &evaluation, sizeof(bits));
+            m_table.store(worker.miss_hashes[i], bits);
+        }
+    }
+
+    worker.nodes += count;
+}
+
+void Bot::play(Game& game, ReplayRecorder* recorder)
+{
+    std::int32_t key;
+
+    if (game.game_over()) {
+        if (m_keys_down) {
+            set_key(game, recorder, GAME_KEY_SOFT_DROP, false);
+        }
+        m_planned = false;
+        return;
+    }
+
+    // Hold swaps in the planned piece, which is not a new one to decide on.
+    if (m_hold_pending && game.hold_used()) {
+        m_hold_pending = false;
+        m_plan_pieces = game.pieces();
+    }
+
+    if ( ! m_planned || (game.pieces() != m_plan_pieces && ! m_hold_pending)) {
+        decide(game);
+        m_planned = true;
+        m_plan_pieces = game.pieces();
+        m_hold_pending = m_decision.hold;
+    }
+
+    if (m_hold_pending) {
+        key = GAME_KEY_HOLD;
+    } else {
+        key = find_key(game);
+        if (key < 0) {
+            // Gravity or a lock reset running out took the placement away.
+            decide(game);
+            m_hold_pending = m_decision.hold;
+            key = m_hold_pending ? GAME_KEY_HOLD : find_key(game);
+        }
+        if (key < 0) {
+            key = GAME_KEY_HARD_DROP;
+        }
+    }
+
+    // Soft drop is held, everything else tapped.
+    if (GAME_KEY_SOFT_DROP == key) {
+        if ( ! m_keys_down) {
+            set_key(game, recorder, GAME_KEY_SOFT_DROP, true);
+        }
+        return;
+    }
+
+    if (m_keys_down) {
+        set_key(game, recorder, GAME_KEY_SOFT_DROP, false);
+    }
+
+    set_key(game, recorder, key, true);
+    set_key(game, recorder, key, false);
+}
+
+/*
+ * First key of the shortest path taking the current piece to a state from
+ * which hard dropping lands on the planned placement. Breadth-first over
+ * the same moves the move generator searches, returning -1 when the
+ * placement can not be reached.
+ */
+std::int32_t Bot::find_key(const Game& game)
+{
+    std::uint32_t head;
+    std::uint32_t tail;
+    std::uint32_t state;
+    std::uint32_t next;
+    std::int32_t rotation;
+    std::int32_t x;
+    std::int32_t y;
+    std::int32_t key;
+    std::int32_t moved_rotation;
+    std::int32_t moved_x;
+    std::int32_t moved_y;
+
+    const Board& board = game.board();
+    const ActivePiece& piece = game.piece();
+    const Placement& target = m_decision.placement;
+
+    if (piece.type != m_decision.type) {
+        return -1;
+    }
+
+    m_first_key.fill(0);
+
+    head = 0;
+    tail = 0;
+    state = path_state(piece.rotation, piece.x, piece.y);
+    m_first_key[state] = GAME_KEY_HARD_DROP + 1;
+    m_path_queue[tail++] = static_cast<std::uint16_t>(state);
+
+    while (head != tail) {
+        state = m_path_queue[head++];
+        key = m_first_key[state] - 1;
+
+        y = static_cast<std::int32_t>(state % MOVE_GENERATOR_ROWS) - BOARD_FLOOR_ROWS;
+        x = static_cast<std::int32_t>(state / MOVE_GENERATOR_ROWS % 16) - BOARD_WALL_LEFT;
+        rotation = static_cast<std::int32_t>(state / MOVE_GENERATOR_ROWS / 16);
+
+        const PieceRows& rows = tetromino_rows(piece.type, rotation);
+
+        if (rotation == target.rotation && x == target.x &&
+                y - board.drop_distance(rows, x, y) == target.y) {
+            return key;
+        }
+
+        for (std::int32_t path_key : g_path_keys) {
+            moved_rotation = rotation;
+            moved_x = x;
+            moved_y = y;
+
+            if (GAME_KEY_LEFT == path_key || GAME_KEY_RIGHT == path_key) {
+                moved_x += GAME_KEY_LEFT == path_key ? -1 : 1;
+                if (board.collides(rows, moved_x, moved_y)) {
+                    continue;
+                }
+            } else if (GAME_KEY_SOFT_DROP == path_key) {
+                moved_y--;
+                if (board.collides(rows, moved_x, moved_y)) {
+                    continue;
+                }
+            } else if (0 > tetromino_rotate(
+                        board,
+                        piece.type,
+                        GAME_KEY_ROTATE_CW == path_key ? ROTATE_CW : ROTATE_CCW,
+                        moved_rotation,
+                        moved_x,
+                        moved_y)) {
+                continue;
+            }
+
+            next = path_state(moved_rotation, moved_x, moved_y);
+            if (0 != m_first_key[next]) {
+                continue;
+            }
+
+            // First step of the path is the key itself.
+            m_first_key[next] = static_cast<std::uint8_t>(
+                    (GAME_KEY_HARD_DROP == key ? path_key : key) + 1);
+            m_path_queue[tail++] = static_cast<std::uint16_t>(next);
+        }
+    }
+
+    return -1;
+}
+
+void Bot::set_key(Game& game, ReplayRecorder* recorder, std::int32_t key, bool pressed)
+{
+    if (nullptr != recorder) {
+        recorder->record_key(game, key, pressed, 0);
+    }
+    game.set_key(key, pressed, 0);
+
+    if (GAME_KEY_SOFT_DROP == key) {
+        m_keys_down = pressed ? 1u << key : 0;
+    }
+}
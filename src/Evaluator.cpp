@@ -0,0 +1,407 @@
+#include "Evaluator.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// Pairs of horizontally adjacent bits from the left wall column to the right
+// wall column, compared by xoring a row with itself shifted by one.
+constexpr BoardRow g_row_transition_pairs =
+    ((1u << (BOARD_WIDTH + 1)) - 1) << (BOARD_WALL_LEFT - 1);
+
+// Rows a batch kernel reads per board, from the floor row below row 0 up to
+// the ceiling row two above the highest row a T slot can start at.
+#define EVALUATOR_BATCH_ROWS (BOARD_HEIGHT + 2)
+
+const char* const g_evaluator_kernel_names[EVALUATOR_KERNEL_COUNT] = {
+    "scalar", "sse2", "avx2",
+};
+
+EvaluatorWeights evaluator_default_weights()
+{
+    EvaluatorWeights weights;
+
+    weights = {};
+
+    weights.max_height = -0.5f;
+    weights.holes = -4.0f;
+    weights.bumpiness = -0.6f;
+    weights.row_transitions = -1.0f;
+    weights.column_transitions = -2.0f;
+    weights.well_depth = 0.5f;
+    weights.t_slot_lines = 2.0f;
+
+    return weights;
+}
+
+/*
+ * Lines cleared by a T pointing down into a slot whose stem cell sits at
+ * row y. Slot needs the stem and the row above it open, with at least three
+ * of the four corners around the T centre filled.
+ */
+static std::int32_t
+t_slot_lines(const Board& board, std::int32_t y)
+{
+    std::uint32_t below;
+    std::uint32_t stem;
+    std::uint32_t middle;
+    std::uint32_t top;
+    std::uint32_t slots;
+    std::uint32_t left_low;
+    std::uint32_t right_low;
+    std::uint32_t left_high;
+    std::uint32_t right_high;
+    std::uint32_t corners;
+    std::uint32_t bit;
+    std::int32_t lines;
+    std::int32_t best;
+
+    below = board.row(y - 1);
+    stem = board.row(y);
+    middle = board.row(y + 1);
+    top = board.row(y + 2);
+
+    // Bit b of each mask tells about the cell at column b.
+    left_low = stem << 1;
+    right_low = stem >> 1;
+    left_high = top << 1;
+    right_high = top >> 1;
+    corners = (left_low & right_low & (left_high | right_high)) |
+        (left_high & right_high & (left_low | right_low));
+
+    slots = ~stem & ~middle & ~(middle << 1) & ~(middle >> 1) & ~top &
+        below & corners & g_board_row_cells;
+
+    best = 0;
+    while (slots) {
+        bit = slots & (0u - slots);
+        slots &= slots - 1;
+
+        lines = (g_board_row_full == (stem | bit)) +
+            (g_board_row_full == (middle | bit | (bit << 1) | (bit >> 1)));
+        best = std::max(best, lines);
+    }
+
+    return best;
+}
+
+void evaluator_features(const Board& board, BoardFeatures& features)
+{
+    std::int32_t heights[BOARD_WIDTH];
+    std::int32_t top;
+    std::int32_t left;
+    std::int32_t right;
+    std::uint32_t covered;
+    std::uint32_t cells;
+    std::uint32_t previous;
+    std::uint32_t topped;
+    BoardRow row;
+
+    features = {};
+
+    top = BOARD_HEIGHT;
+    while (top > 0 && 0 == board.row_cells(top - 1)) {
+        top--;
+    }
+
+    features.max_height = top;
+
+    // Top down, so that a column is covered from its highest cell onwards.
+    covered = 0;
+    std::fill(heights, heights + BOARD_WIDTH, 0);
+    for (std::int32_t y = top - 1; y >= 0; y--) {
+        cells = board.row_cells(y);
+        row = board.row(y);
+
+        topped = cells & ~covered;
+        while (topped) {
+            heights[__builtin_ctz(topped)] = y + 1;
+            topped &= topped - 1;
+        }
+
+        features.holes += __builtin_popcount(~cells & covered);
+        covered |= cells;
+
+        features.row_transitions += __builtin_popcount(
+                (row ^ (row >> 1)) & g_row_transition_pairs);
+    }
+
+    previous = (1u << BOARD_WIDTH) - 1;
+    for (std::int32_t y = 0; y < top; y++) {
+        cells = board.row_cells(y);
+        features.column_transitions += __builtin_popcount(cells ^ previous);
+        previous = cells;
+    }
+
+    for (std::int32_t column = 0; column < BOARD_WIDTH; column++) {
+        left = 0 == column ? BOARD_HEIGHT : heights[column - 1];
+        right = BOARD_WIDTH - 1 == column ? BOARD_HEIGHT : heights[column + 1];
+
+        features.well_depth = std::max(
+                features.well_depth,
+                std::min(left, right) - heights[column]);
+
+        if (column > 0) {
+            features.bumpiness += std::abs(heights[column] - heights[column - 1]);
+        }
+    }
+
+    // Slot rows reach up to two rows above the highest column.
+    for (std::int32_t y = 0; y < top && y + 2 < BOARD_HEIGHT; y++) {
+        features.t_slot_lines = std::max(features.t_slot_lines, t_slot_lines(board, y));
+    }
+}
+
+/*
+ * Batch kernel written with vector extensions, so that the same code builds
+ * for each vector width. It is always inlined into a wrapper compiled for
+ * the instruction set the width needs. Lanes hold one board each, rows
+ * including their walls. Masks from comparisons are all ones when true.
+ */
+// Vectors go by reference, as passing wide ones by value changes the ABI
+// depending on the instruction set.
+template<typename U, typename S>
+static inline __attribute__((always_inline)) void
+lane_popcount_add(S& sum, const U& mask, const U& value)
+{
+    U x;
+
+    x = value - ((value >> 1) & 0x5555);
+    x = (x & 0x3333) + ((x >> 2) & 0x3333);
+    x = (x + (x >> 4)) & 0x0F0F;
+    sum += (S)(mask & ((x + (x >> 8)) & 0x1F));
+}
+
+template<typename U, typename S, std::int32_t N>
+static inline __attribute__((always_inline)) void
+features_lanes(const Board* boards, std::uint32_t count, BoardFeatures* features)
+{
+    alignas(sizeof(U)) std::uint16_t rows[EVALUATOR_BATCH_ROWS + 1][N];
+    U row[EVALUATOR_BATCH_ROWS + 1];
+    S heights[BOARD_WIDTH];
+    S tops;
+    S live;
+    S holes;
+    S row_transitions;
+    S column_transitions;
+    S t_slot_lines;
+    S bumpiness;
+    S well_depth;
+    S left;
+    S right;
+    S depth;
+    U cells;
+    U covered;
+    U topped;
+    U below;
+    U stem;
+    U middle;
+    U top;
+    U corners;
+    U slots;
+    U missing_stem;
+    U missing_middle;
+    U centre;
+    S stem_line;
+    S middle_line;
+    S lines;
+    std::int32_t lanes;
+    std::int32_t max_top;
+
+    static const Board empty;
+
+    for (std::uint32_t base = 0; base < count; base += N) {
+        lanes = static_cast<std::int32_t>(std::min<std::uint32_t>(count - base, N));
+
+        // Rows of a board are spread over the lanes, row -1 first. Lanes
+        // past the end of the batch get an empty board.
+        for (std::int32_t lane = 0; lane < N; lane++) {
+            const Board& board = lane < lanes ? boards[base + lane] : empty;
+            const BoardRow* source = board.rows() - 1;
+
+            for (std::int32_t y = 0; y <= EVALUATOR_BATCH_ROWS; y++) {
+                rows[y][lane] = source[y];
+            }
+        }
+
+        for (std::int32_t y = 0; y <= EVALUATOR_BATCH_ROWS; y++) {
+            std::memcpy(&row[y], rows[y], sizeof(U));
+        }
+
+        tops = (S){};
+        for (std::int32_t y = 0; y < BOARD_HEIGHT; y++) {
+            tops = 0 != (row[y + 1] & g_board_row_cells) ?
+                (S){} + static_cast<std::int16_t>(y + 1) : tops;
+        }
+
+        max_top = 0;
+        for (std::int32_t lane = 0; lane < N; lane++) {
+            max_top = std::max<std::int32_t>(max_top, tops[lane]);
+        }
+
+        holes = (S){};
+        row_transitions = (S){};
+        column_transitions = (S){};
+        t_slot_lines = (S){};
+        covered = (U){};
+        for (std::int32_t column = 0; column < BOARD_WIDTH; column++) {
+            heights[column] = (S){};
+        }
+
+        // Top down, so that a column is covered from its highest cell onwards.
+        for (std::int32_t y = max_top - 1; y >= 0; y--) {
+            live = tops > static_cast<std::int16_t>(y);
+            cells = row[y + 1] & g_board_row_cells;
+
+            topped = cells & ~covered;
+            for (std::int32_t column = 0; column < BOARD_WIDTH; column++) {
+                heights[column] = 0 != (topped & static_cast<std::uint16_t>(
+                            1u << (column + BOARD_WALL_LEFT))) ?
+                    (S){} + static_cast<std::int16_t>(y + 1) : heights[column];
+            }
+
+            lane_popcount_add<U, S>(holes, ~(U){}, ~cells & covered);
+            covered |= cells;
+
+            lane_popcount_add<U, S>(
+                    row_transitions,
+                    (U)live,
+                    (row[y + 1] ^ (row[y + 1] >> 1)) & g_row_transition_pairs);
+            // Floor row is full within the playfield.
+            lane_popcount_add<U, S>(
+                    column_transitions,
+                    (U)live,
+                    cells ^ (row[y] & g_board_row_cells));
+
+            if (y + 2 >= BOARD_HEIGHT) {
+                continue;
+            }
+
+            below = row[y];
+            stem = row[y + 1];
+            middle = row[y + 2];
+            top = row[y + 3];
+
+            corners = (stem << 1 & stem >> 1 & (top << 1 | top >> 1)) |
+                (top << 1 & top >> 1 & (stem << 1 | stem >> 1));
+            slots = ~stem & ~middle & ~(middle << 1) & ~(middle >> 1) & ~top &
+                below & corners & g_board_row_cells;
+
+            /*
+             * A slot clears the stem row only when it is the one cell
+             * missing there, and the middle row only when the three cells
+             * around it are all that is missing, so that at most one slot
+             * clears each row.
+             */
+            missing_stem = ~stem & g_board_row_cells;
+            missing_middle = ~middle & g_board_row_cells;
+            centre = missing_middle & (missing_middle << 1) & (missing_middle >> 1);
+
+            stem_line = (0 != (missing_stem & slots)) &
+                (0 == (missing_stem & (missing_stem - 1)));
+            middle_line = (0 != (centre & slots)) &
+                (0 == (centre & (centre - 1))) &
+                (missing_middle == (centre | centre << 1 | centre >> 1));
+
+            lines = live & ((1 & (stem_line | middle_line)) +
+                    (1 & stem_line & middle_line & (missing_stem == centre)));
+            t_slot_lines = lines > t_slot_lines ? lines : t_slot_lines;
+        }
+
+        bumpiness = (S){};
+        well_depth = (S){};
+        for (std::int32_t column = 0; column < BOARD_WIDTH; column++) {
+            left = 0 == column ? (S){} + BOARD_HEIGHT : heights[column - 1];
+            right = BOARD_WIDTH - 1 == column ? (S){} + BOARD_HEIGHT : heights[column + 1];
+            depth = (left < right ? left : right) - heights[column];
+            well_depth = depth > well_depth ? depth : well_depth;
+
+            if (column > 0) {
+                depth = heights[column] - heights[column - 1];
+                bumpiness += depth > 0 ? depth : -depth;
+            }
+        }
+
+        for (std::int32_t lane = 0; lane < lanes; lane++) {
+            BoardFeatures& result = features[base + lane];
+
+            result.max_height = tops[lane];
+            result.holes = holes[lane];
+            result.bumpiness = bumpiness[lane];
+            result.row_transitions = row_transitions[lane];
+            result.column_transitions = column_transitions[lane];
+            result.well_depth = well_depth[lane];
+            result.t_slot_lines = t_slot_lines[lane];
+        }
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+typedef std::uint16_t EvaluatorU16x8 __attribute__((vector_size(16)));
+typedef std::int16_t EvaluatorS16x8 __attribute__((vector_size(16)));
+typedef std::uint16_t EvaluatorU16x16 __attribute__((vector_size(32)));
+typedef std::int16_t EvaluatorS16x16 __attribute__((vector_size(32)));
+
+__attribute__((target("sse2"))) static void
+features_sse2(const Board* boards, std::uint32_t count, BoardFeatures* features)
+{
+    features_lanes<EvaluatorU16x8, EvaluatorS16x8, 8>(boards, count, features);
+}
+
+__attribute__((target("avx2"))) static void
+features_avx2(const Board* boards, std::uint32_t count, BoardFeatures* features)
+{
+    features_lanes<EvaluatorU16x16, EvaluatorS16x16, 16>(boards, count, features);
+}
+
+#endif
+
+std::int32_t evaluator_detect_kernel()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return EVALUATOR_KERNEL_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return EVALUATOR_KERNEL_SSE2;
+    }
+#endif
+
+    return EVALUATOR_KERNEL_SCALAR;
+}
+
+void evaluator_features_batch(
+        std::int32_t kernel,
+        const Board* boards,
+        std::uint32_t count,
+        BoardFeatures* features)
+{
+    switch (kernel) {
+#if defined(__x86_64__) || defined(__i386__)
+    case EVALUATOR_KERNEL_AVX2:
+        features_avx2(boards, count, features);
+        break;
+    case EVALUATOR_KERNEL_SSE2:
+        features_sse2(boards, count, features);
+        break;
+#endif
+    default:
+        for (std::uint32_t i = 0; i < count; i++) {
+            evaluator_features(boards[i], features[i]);
+        }
+        break;
+    }
+}
+
+float evaluator_score(const BoardFeatures& features, const EvaluatorWeights& weights)
+{
+    return weights.max_height * features.max_height +
+        weights.holes * features.holes +
+        weights.bumpiness * features.bumpiness +
+        weights.row_transitions * features.row_transitions +
+        weights.column_transitions * features.column_transitions +
+        weights.well_depth * features.well_depth +
+        weights.t_slot_lines * features.t_slot_lines;
+}
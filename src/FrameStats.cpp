@@ -0,0 +1,95 @@
+#include "FrameStats.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include "Log.hpp"
+
+static const char* const g_phase_names[FRAME_PHASE_COUNT] = {
+    "acquire",
+    "record",
+    "submit",
+    "present",
+    "cpu_total",
+    "gpu_render",
+    "recreate",
+    "input_latency",
+};
+
+FrameStats::FrameStats()
+{
+    for (std::array<std::uint32_t, FRAME_STATS_WINDOW>& samples : m_samples) {
+        samples.fill(0);
+    }
+    m_counts.fill(0);
+}
+
+FramePhaseSummary FrameStats::summarize(std::int32_t phase) const
+{
+    std::vector<std::uint32_t> sorted;
+    std::size_t size;
+    FramePhaseSummary summary;
+
+    summary = {};
+    summary.count = m_counts[phase];
+
+    size = std::min<std::uint64_t>(m_counts[phase], FRAME_STATS_WINDOW);
+    if (0 == size) {
+        return summary;
+    }
+
+    sorted.assign(m_samples[phase].begin(), m_samples[phase].begin() + size);
+    std::sort(sorted.begin(), sorted.end());
+
+    // Nearest rank
+    summary.p50_ns = sorted[(size * 50 + 99) / 100 - 1];
+    summary.p99_ns = sorted[(size * 99 + 99) / 100 - 1];
+    summary.max_ns = sorted[size - 1];
+
+    return summary;
+}
+
+void FrameStats::log() const
+{
+    FramePhaseSummary summary;
+
+    LOG_I("Frame timings over the last {} frames, in microseconds:",
+            FRAME_STATS_WINDOW);
+
+    for (std::int32_t phase = 0; phase < FRAME_PHASE_COUNT; phase++) {
+        summary = summarize(phase);
+        if (0 == summary.count) {
+            continue;
+        }
+
+        LOG_I("{}: p50 {} p99 {} max {} ({} samples)",
+                g_phase_names[phase],
+                summary.p50_ns / 1000.0,
+                summary.p99_ns / 1000.0,
+                summary.max_ns / 1000.0,
+                summary.count);
+    }
+}
+
+void FrameStats::write_csv(const std::string& path) const
+{
+    FramePhaseSummary summary;
+
+    std::ofstream file(path, std::ios::trunc);
+
+    file << "phase,count,p50_us,p99_us,max_us\n";
+    for (std::int32_t phase = 0; phase < FRAME_PHASE_COUNT; phase++) {
+        summary = summarize(phase);
+        file << g_phase_names[phase] << ','
+            << summary.count << ','
+            << summary.p50_ns / 1000.0 << ','
+            << summary.p99_ns / 1000.0 << ','
+            << summary.max_ns / 1000.0 << '\n';
+    }
+
+    if ( ! file) {
+        throw std::runtime_error("Failed to write frame stats to " + path);
+    }
+}
@@ -0,0 +1,393 @@
+#include "Game.hpp"
+
+#include <algorithm>
+
+Game::Game(const GameSettings& settings, std::uint64_t seed) :
+    m_settings(settings),
+    m_randomizer(settings.randomizer, seed)
+{
+    reset(seed);
+}
+
+GameSettings Game::default_settings()
+{
+    GameSettings settings;
+
+    settings = {};
+
+    settings.das_ticks = 10;
+    settings.arr_ticks = 2;
+    settings.gravity = GAME_GRAVITY_ONE / GAME_TICK_RATE;
+    settings.soft_drop_factor = 20;
+    settings.lock_delay_ticks = 30;
+    settings.lock_reset_limit = 15;
+    settings.randomizer = RANDOMIZER_BAG;
+
+    return settings;
+}
+
+void Game::reset(std::uint64_t seed)
+{
+    m_seed = seed;
+    m_randomizer.reset(seed);
+    m_board.clear();
+    m_cell_types.fill(0);
+
+    m_hold = -1;
+    m_hold_used = false;
+
+    m_keys_down = 0;
+    m_keys_pressed = 0;
+    m_press_ages.fill(0);
+    m_das_counter = 0;
+    m_arr_counter = 0;
+    m_shift_direction = 0;
+
+    m_game_over = false;
+    m_ticks = 0;
+    m_lines = 0;
+    m_version = 0;
+
+    spawn(take_next());
+}
+
+void Game::save(GameSnapshot& snapshot) const
+{
+    std::int32_t cell;
+
+    snapshot = {};
+
+    snapshot.seed = m_seed;
+    snapshot.pieces = m_randomizer.taken();
+    snapshot.ticks = m_ticks;
+    snapshot.lines = m_lines;
+    snapshot.version = m_version;
+
+    snapshot.das_counter = m_das_counter;
+    snapshot.arr_counter = m_arr_counter;
+    snapshot.gravity_accumulator = m_gravity_accumulator;
+    snapshot.lock_counter = m_lock_counter;
+    snapshot.lock_resets = m_lock_resets;
+    for (std::int32_t key = 0; key < GAME_KEY_COUNT; key++) {
+        snapshot.press_ages[key] = static_cast<std::uint16_t>(m_press_ages[key]);
+    }
+
+    snapshot.piece_type = static_cast<std::int8_t>(m_piece.type);
+    snapshot.piece_rotation = static_cast<std::int8_t>(m_piece.rotation);
+    snapshot.piece_x = static_cast<std::int8_t>(m_piece.x);
+    snapshot.piece_y = static_cast<std::int8_t>(m_piece.y);
+    snapshot.hold = static_cast<std::int8_t>(m_hold);
+    snapshot.shift_direction = static_cast<std::int8_t>(m_shift_direction);
+    snapshot.hold_used = m_hold_used;
+    snapshot.game_over = m_game_over;
+    snapshot.keys_down = static_cast<std::uint8_t>(m_keys_down);
+    snapshot.keys_pressed = static_cast<std::uint8_t>(m_keys_pressed);
+
+    for (cell = 0; cell < BOARD_WIDTH * BOARD_HEIGHT; cell++) {
+        snapshot.cells[cell / 2] |= static_cast<std::uint8_t>(
+                m_cell_types[cell] << ((cell & 1) * 4));
+    }
+}
+
+void Game::restore(const GameSnapshot& snapshot)
+{
+    std::int32_t cell;
+
+    m_seed = snapshot.seed;
+    m_randomizer.reset(snapshot.seed);
+    m_randomizer.discard(snapshot.pieces);
+
+    m_ticks = snapshot.ticks;
+    m_lines = snapshot.lines;
+    m_version = snapshot.version;
+
+    m_das_counter = snapshot.das_counter;
+    m_arr_counter = snapshot.arr_counter;
+    m_gravity_accumulator = snapshot.gravity_accumulator;
+    m_lock_counter = snapshot.lock_counter;
+    m_lock_resets = snapshot.lock_resets;
+    for (std::int32_t key = 0; key < GAME_KEY_COUNT; key++) {
+        m_press_ages[key] = snapshot.press_ages[key];
+    }
+
+    m_piece.type = snapshot.piece_type;
+    m_piece.rotation = snapshot.piece_rotation;
+    m_piece.x = snapshot.piece_x;
+    m_piece.y = snapshot.piece_y;
+    m_hold = snapshot.hold;
+    m_shift_direction = snapshot.shift_direction;
+    m_hold_used = 0 != snapshot.hold_used;
+    m_game_over = 0 != snapshot.game_over;
+    m_keys_down = snapshot.keys_down;
+    m_keys_pressed = snapshot.keys_pressed;
+
+    m_board.clear();
+    for (cell = 0; cell < BOARD_WIDTH * BOARD_HEIGHT; cell++) {
+        m_cell_types[cell] = (snapshot.cells[cell / 2] >> ((cell & 1) * 4)) & 0xF;
+        if (0 != m_cell_types[cell]) {
+            m_board.set_cell(cell % BOARD_WIDTH, cell / BOARD_WIDTH);
+        }
+    }
+}
+
+void Game::set_key(std::int32_t key, bool pressed, std::int32_t age)
+{
+    std::uint32_t bit;
+
+    bit = 1u << key;
+
+    if (pressed) {
+        if (bit & ~m_keys_down) {
+            m_press_ages[key] = age;
+        }
+        m_keys_pressed |= bit & ~m_keys_down;
+        m_keys_down |= bit;
+    } else {
+        m_keys_down &= ~bit;
+    }
+}
+
+std::int32_t Game::ghost_y() const
+{
+    return m_piece.y - m_board.drop_distance(
+            tetromino_rows(m_piece.type, m_piece.rotation),
+            m_piece.x,
+            m_piece.y);
+}
+
+std::int32_t Game::next(std::int32_t i) const
+{
+    return m_randomizer.peek(i);
+}
+
+std::int32_t Game::take_next()
+{
+    return m_randomizer.next();
+}
+
+void Game::spawn(std::int32_t type)
+{
+    m_piece.type = type;
+    m_piece.rotation = ROTATION_SPAWN;
+    m_piece.x = TETROMINO_SPAWN_X;
+    m_piece.y = g_tetromino_spawn_y[type];
+
+    m_gravity_accumulator = 0;
+    m_lock_counter = 0;
+    m_lock_resets = 0;
+    m_version++;
+
+    if (m_board.collides(tetromino_rows(type, ROTATION_SPAWN), m_piece.x, m_piece.y)) {
+        m_game_over = true;
+    }
+}
+
+bool Game::try_move(std::int32_t dx, std::int32_t dy)
+{
+    const PieceRows& rows = tetromino_rows(m_piece.type, m_piece.rotation);
+
+    if (m_board.collides(rows, m_piece.x + dx, m_piece.y + dy)) {
+        return false;
+    }
+
+    m_piece.x += dx;
+    m_piece.y += dy;
+    on_moved();
+
+    return true;
+}
+
+void Game::on_moved()
+{
+    bool grounded;
+
+    m_version++;
+
+    grounded = m_board.collides(
+            tetromino_rows(m_piece.type, m_piece.rotation),
+            m_piece.x,
+            m_piece.y - 1);
+    if (grounded && m_lock_resets < m_settings.lock_reset_limit) {
+        m_lock_counter = 0;
+        m_lock_resets++;
+    }
+}
+
+void Game::shift(std::int32_t direction, std::int32_t key)
+{
+    if (m_keys_pressed & (1u << key)) {
+        // Most recently pressed direction wins.
+        m_shift_direction = direction;
+        m_das_counter = m_press_ages[key];
+        m_arr_counter = 0;
+        try_move(direction, 0);
+    }
+}
+
+void Game::tick()
+{
+    std::int32_t gravity;
+    std::int32_t distance;
+    std::int32_t das;
+    std::int32_t arr;
+    std::uint32_t pressed;
+    bool grounded;
+
+    m_ticks++;
+
+    if (m_game_over) {
+        m_keys_pressed = 0;
+        return;
+    }
+
+    pressed = m_keys_pressed;
+
+    if ((pressed & (1u << GAME_KEY_HOLD)) && ! m_hold_used) {
+        std::int32_t held;
+
+        held = m_hold;
+        m_hold = m_piece.type;
+        spawn(held < 0 ? take_next() : held);
+        m_hold_used = true;
+    }
+
+    if (pressed & (1u << GAME_KEY_ROTATE_CW)) {
+        if (0 <= tetromino_rotate(m_board, m_piece.type, ROTATE_CW,
+                    m_piece.rotation, m_piece.x, m_piece.y)) {
+            on_moved();
+        }
+    }
+
+    if (pressed & (1u << GAME_KEY_ROTATE_CCW)) {
+        if (0 <= tetromino_rotate(m_board, m_piece.type, ROTATE_CCW,
+                    m_piece.rotation, m_piece.x, m_piece.y)) {
+            on_moved();
+        }
+    }
+
+    shift(-1, GAME_KEY_LEFT);
+    shift(1, GAME_KEY_RIGHT);
+    m_keys_pressed = 0;
+
+    // Fall back to the other direction when the active one gets released.
+    if (-1 == m_shift_direction && ! (m_keys_down & (1u << GAME_KEY_LEFT))) {
+        m_shift_direction = (m_keys_down & (1u << GAME_KEY_RIGHT)) ? 1 : 0;
+        m_das_counter = 0;
+    }
+    if (1 == m_shift_direction && ! (m_keys_down & (1u << GAME_KEY_RIGHT))) {
+        m_shift_direction = (m_keys_down & (1u << GAME_KEY_LEFT)) ? -1 : 0;
+        m_das_counter = 0;
+    }
+
+    if (0 != m_shift_direction) {
+        das = m_settings.das_ticks * GAME_SUBTICK_ONE;
+        arr = m_settings.arr_ticks * GAME_SUBTICK_ONE;
+
+        if (m_das_counter < das) {
+            m_das_counter += GAME_SUBTICK_ONE;
+            // Part of the tick past the delay counts towards the first repeat.
+            if (m_das_counter > das) {
+                m_arr_counter = m_das_counter - das;
+                m_das_counter = das;
+            }
+        } else if (0 == arr) {
+            while (try_move(m_shift_direction, 0)) {
+            }
+        } else {
+            m_arr_counter += GAME_SUBTICK_ONE;
+            if (m_arr_counter >= arr) {
+                m_arr_counter -= arr;
+                try_move(m_shift_direction, 0);
+            }
+        }
+    }
+
+    if (pressed & (1u << GAME_KEY_HARD_DROP)) {
+        distance = m_board.drop_distance(
+                tetromino_rows(m_piece.type, m_piece.rotation),
+                m_piece.x,
+                m_piece.y);
+        m_piece.y -= distance;
+        lock();
+        return;
+    }
+
+    gravity = m_settings.gravity;
+    if (m_keys_down & (1u << GAME_KEY_SOFT_DROP)) {
+        gravity *= m_settings.soft_drop_factor;
+    }
+
+    m_gravity_accumulator += gravity;
+    while (m_gravity_accumulator >= GAME_GRAVITY_ONE) {
+        m_gravity_accumulator -= GAME_GRAVITY_ONE;
+        if ( ! try_move(0, -1)) {
+            m_gravity_accumulator = 0;
+            break;
+        }
+    }
+
+    grounded = m_board.collides(
+            tetromino_rows(m_piece.type, m_piece.rotation),
+            m_piece.x,
+            m_piece.y - 1);
+    if ( ! grounded) {
+        m_lock_counter = 0;
+        return;
+    }
+
+    if (++m_lock_counter >= m_settings.lock_delay_ticks) {
+        lock();
+    }
+}
+
+void Game::lock()
+{
+    std::int32_t row;
+    std::int32_t write;
+    std::uint32_t full;
+    std::uint64_t full_rows;
+
+    const PieceRows& rows = tetromino_rows(m_piece.type, m_piece.rotation);
+
+    for (std::int32_t i = 0; i < BOARD_PIECE_ROWS; i++) {
+        row = m_piece.y + i;
+        if (row < 0 || row >= BOARD_HEIGHT) {
+            continue;
+        }
+
+        for (std::int32_t column = 0; column < BOARD_PIECE_ROWS; column++) {
+            if (rows.rows[i] & (1u << column)) {
+                m_cell_types[row * BOARD_WIDTH + m_piece.x + column] =
+                    static_cast<std::uint8_t>(m_piece.type + 1);
+            }
+        }
+    }
+
+    full = m_board.place(rows, m_piece.x, m_piece.y);
+    if (full) {
+        // Compact cell types the same way the bitboard compacts its rows.
+        full_rows = m_board.full_rows();
+        write = 0;
+        for (row = 0; row < BOARD_HEIGHT; row++) {
+            if (full_rows & (1ull << row)) {
+                continue;
+            }
+            if (write != row) {
+                std::copy_n(
+                        &m_cell_types[row * BOARD_WIDTH],
+                        BOARD_WIDTH,
+                        &m_cell_types[write * BOARD_WIDTH]);
+            }
+            write++;
+        }
+        std::fill(
+                m_cell_types.begin() + write * BOARD_WIDTH,
+                m_cell_types.end(),
+                0);
+
+        m_lines += m_board.clear_lines();
+    }
+
+    m_hold_used = false;
+    spawn(take_next());
+}
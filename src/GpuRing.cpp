@@ -0,0 +1,174 @@
+#include "GpuRing.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+// Ring part starts after the static part, keep it aligned for any use.
+#define GPU_RING_BASE_ALIGNMENT 256
+
+static std::uint64_t
+align_up(std::uint64_t value, std::uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+std::uint32_t gpu_find_memory_type(
+        const VkPhysicalDevice& physical_device,
+        std::uint32_t type_bits,
+        VkMemoryPropertyFlags properties)
+{
+    VkPhysicalDeviceMemoryProperties memory_properties;
+
+    memory_properties = {};
+
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+    for (std::uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+        if ((type_bits & (1u << i)) &&
+                properties == (memory_properties.memoryTypes[i].propertyFlags & properties)) {
+            return i;
+        }
+    }
+
+    throw std::runtime_error("Failed to find suitable memory type");
+}
+
+GpuRing::GpuRing() :
+    m_buffer(VK_NULL_HANDLE),
+    m_memory(VK_NULL_HANDLE),
+    m_mapped(nullptr),
+    m_static_size(0),
+    m_static_head(0),
+    m_ring_size(0),
+    m_head(0),
+    m_tail(0),
+    m_frame_slot(0)
+{
+}
+
+void GpuRing::create(
+        const VkPhysicalDevice& physical_device,
+        const VkDevice& logical_device,
+        VkBufferUsageFlags usage,
+        VkDeviceSize static_size,
+        VkDeviceSize ring_size,
+        std::uint32_t frame_slot_count)
+{
+    VkResult result;
+    VkBufferCreateInfo buffer_info;
+    VkMemoryRequirements requirements;
+    VkMemoryAllocateInfo allocate_info;
+    void* mapped;
+
+    result = VK_ERROR_UNKNOWN;
+    buffer_info = {};
+    requirements = {};
+    allocate_info = {};
+    mapped = nullptr;
+
+    m_static_size = align_up(static_size, GPU_RING_BASE_ALIGNMENT);
+    m_static_head = 0;
+    m_ring_size = ring_size;
+    m_head = 0;
+    m_tail = 0;
+    m_frame_end.assign(frame_slot_count, 0);
+    m_frame_slot = 0;
+
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = m_static_size + ring_size;
+    buffer_info.usage = usage;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    result = vkCreateBuffer(logical_device, &buffer_info, nullptr, &m_buffer);
+    if (VK_SUCCESS != result) {
+        throw std::runtime_error("Failed to create ring buffer");
+    }
+
+    vkGetBufferMemoryRequirements(logical_device, m_buffer, &requirements);
+
+    allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocate_info.allocationSize = requirements.size;
+    allocate_info.memoryTypeIndex = gpu_find_memory_type(
+            physical_device,
+            requirements.memoryTypeBits,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    result = vkAllocateMemory(logical_device, &allocate_info, nullptr, &m_memory);
+    if (VK_SUCCESS != result) {
+        throw std::runtime_error("Failed to allocate ring buffer memory");
+    }
+
+    vkBindBufferMemory(logical_device, m_buffer, m_memory, 0);
+
+    result = vkMapMemory(logical_device, m_memory, 0, buffer_info.size, 0, &mapped);
+    if (VK_SUCCESS != result) {
+        throw std::runtime_error("Failed to map ring buffer memory");
+    }
+
+    m_mapped = static_cast<std::uint8_t*>(mapped);
+}
+
+void GpuRing::destroy(const VkDevice& logical_device)
+{
+    if (VK_NULL_HANDLE == m_buffer) {
+        return;
+    }
+
+    vkUnmapMemory(logical_device, m_memory);
+    vkDestroyBuffer(logical_device, m_buffer, nullptr);
+    vkFreeMemory(logical_device, m_memory, nullptr);
+
+    m_buffer = VK_NULL_HANDLE;
+    m_memory = VK_NULL_HANDLE;
+    m_mapped = nullptr;
+}
+
+void GpuRing::begin_frame(std::uint32_t frame_slot)
+{
+    // Queue executes in submission order, so every frame before the
+    // completed one is done as well.
+    m_tail = std::max(m_tail, m_frame_end[frame_slot]);
+    m_frame_slot = frame_slot;
+    m_frame_end[frame_slot] = m_head;
+}
+
+struct GpuRing::Allocation GpuRing::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+    std::uint64_t start;
+    struct Allocation allocation;
+
+    start = align_up(m_head, alignment);
+
+    // Regions are contiguous, skip the remainder at the end of the ring.
+    if (start % m_ring_size + size > m_ring_size) {
+        start = align_up(start, m_ring_size);
+    }
+
+    if (start + size - m_tail > m_ring_size) {
+        throw std::runtime_error("Ring buffer exhausted by frames in flight");
+    }
+
+    m_head = start + size;
+    m_frame_end[m_frame_slot] = m_head;
+
+    allocation.offset = m_static_size + start % m_ring_size;
+    allocation.data = m_mapped + allocation.offset;
+
+    return allocation;
+}
+
+struct GpuRing::Allocation GpuRing::allocate_static(VkDeviceSize size, VkDeviceSize alignment)
+{
+    struct Allocation allocation;
+
+    allocation.offset = align_up(m_static_head, alignment);
+    if (allocation.offset + size > m_static_size) {
+        throw std::runtime_error("Ring buffer static part exhausted");
+    }
+
+    m_static_head = allocation.offset + size;
+    allocation.data = m_mapped + allocation.offset;
+
+    return allocation;
+}
@@ -0,0 +1,208 @@
+#include "ImageWriter.hpp"
+
+#include <array>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#define IMAGE_BYTES_PER_PIXEL 4
+#define DEFLATE_STORED_BLOCK_MAX 65535
+
+static constexpr std::array<std::uint32_t, 256>
+make_crc_table()
+{
+    std::array<std::uint32_t, 256> table = {};
+
+    for (std::uint32_t i = 0; i < 256; i++) {
+        std::uint32_t crc = i;
+        for (std::int32_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+        }
+        table[i] = crc;
+    }
+
+    return table;
+}
+
+static constexpr std::array<std::uint32_t, 256> g_crc_table = make_crc_table();
+
+static std::uint32_t
+crc32_update(std::uint32_t crc, const std::uint8_t* data, std::size_t size)
+{
+    for (std::size_t i = 0; i < size; i++) {
+        crc = g_crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+static void
+put_u32_be(std::vector<std::uint8_t>& out, std::uint32_t value)
+{
+    out.push_back(static_cast<std::uint8_t>(value >> 24));
+    out.push_back(static_cast<std::uint8_t>(value >> 16));
+    out.push_back(static_cast<std::uint8_t>(value >> 8));
+    out.push_back(static_cast<std::uint8_t>(value));
+}
+
+static void
+put_chunk(
+        std::vector<std::uint8_t>& out,
+        const char* type,
+        const std::vector<std::uint8_t>& data)
+{
+    std::uint32_t crc;
+
+    put_u32_be(out, static_cast<std::uint32_t>(data.size()));
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+
+    crc = crc32_update(0xFFFFFFFFu, reinterpret_cast<const std::uint8_t*>(type), 4);
+    crc = crc32_update(crc, data.data(), data.size());
+    put_u32_be(out, crc ^ 0xFFFFFFFFu);
+}
+
+/*
+ * zlib stream of stored blocks holding the filtered scanlines, each prefixed
+ * with filter type 0.
+ */
+static std::vector<std::uint8_t>
+make_image_data(
+        const std::uint8_t* pixels,
+        std::uint32_t width,
+        std::uint32_t height,
+        std::size_t row_pitch)
+{
+    std::vector<std::uint8_t> scanlines;
+    std::vector<std::uint8_t> out;
+    std::size_t row_size;
+    std::size_t offset;
+    std::size_t block_size;
+    std::uint32_t adler_a;
+    std::uint32_t adler_b;
+
+    row_size = static_cast<std::size_t>(width) * IMAGE_BYTES_PER_PIXEL;
+
+    scanlines.reserve((row_size + 1) * height);
+    for (std::uint32_t y = 0; y < height; y++) {
+        scanlines.push_back(0);
+        scanlines.insert(
+                scanlines.end(),
+                pixels + y * row_pitch,
+                pixels + y * row_pitch + row_size);
+    }
+
+    out.reserve(scanlines.size() +
+            (scanlines.size() / DEFLATE_STORED_BLOCK_MAX + 1) * 5 + 6);
+
+    // Deflate, 32K window, no preset dictionary, fastest compression level.
+    out.push_back(0x78);
+    out.push_back(0x01);
+
+    offset = 0;
+    do {
+        block_size = std::min<std::size_t>(
+                scanlines.size() - offset,
+                DEFLATE_STORED_BLOCK_MAX);
+
+        out.push_back(offset + block_size == scanlines.size() ? 1 : 0);
+        out.push_back(static_cast<std::uint8_t>(block_size));
+        out.push_back(static_cast<std::uint8_t>(block_size >> 8));
+        out.push_back(static_cast<std::uint8_t>(~block_size));
+        out.push_back(static_cast<std::uint8_t>(~block_size >> 8));
+        out.insert(
+                out.end(),
+                scanlines.begin() + offset,
+                scanlines.begin() + offset + block_size);
+
+        offset += block_size;
+    } while (offset < scanlines.size());
+
+    // Sums are reduced often enough for 32-bit accumulators not to overflow.
+    adler_a = 1;
+    adler_b = 0;
+    offset = 0;
+    while (offset < scanlines.size()) {
+        block_size = std::min<std::size_t>(scanlines.size() - offset, 5552);
+        for (std::size_t i = 0; i < block_size; i++) {
+            adler_a += scanlines[offset + i];
+            adler_b += adler_a;
+        }
+        adler_a %= 65521;
+        adler_b %= 65521;
+        offset += block_size;
+    }
+    put_u32_be(out, (adler_b << 16) | adler_a);
+
+    return out;
+}
+
+static void
+write_file(const std::string& path, const std::uint8_t* data, std::size_t size)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+    file.write(reinterpret_cast<const char*>(data), size);
+    if ( ! file) {
+        throw std::runtime_error("Failed to write image " + path);
+    }
+}
+
+void image_write_png(
+        const std::string& path,
+        const std::uint8_t* pixels,
+        std::uint32_t width,
+        std::uint32_t height,
+        std::size_t row_pitch)
+{
+    static const std::uint8_t signature[8] = {
+        0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n',
+    };
+
+    std::vector<std::uint8_t> header;
+    std::vector<std::uint8_t> out;
+
+    header.resize(0);
+    out.resize(0);
+
+    put_u32_be(header, width);
+    put_u32_be(header, height);
+    header.push_back(8); // Bit depth
+    header.push_back(6); // Colour type RGBA
+    header.push_back(0); // Compression method
+    header.push_back(0); // Filter method
+    header.push_back(0); // No interlace
+
+    out.insert(out.end(), signature, signature + sizeof(signature));
+    put_chunk(out, "IHDR", header);
+    put_chunk(out, "IDAT", make_image_data(pixels, width, height, row_pitch));
+    put_chunk(out, "IEND", {});
+
+    write_file(path, out.data(), out.size());
+}
+
+void image_write_raw(
+        const std::string& path,
+        const std::uint8_t* pixels,
+        std::uint32_t width,
+        std::uint32_t height,
+        std::size_t row_pitch)
+{
+    std::size_t row_size;
+
+    row_size = static_cast<std::size_t>(width) * IMAGE_BYTES_PER_PIXEL;
+
+    if (row_size == row_pitch) {
+        write_file(path, pixels, row_size * height);
+        return;
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+    for (std::uint32_t y = 0; y < height; y++) {
+        file.write(reinterpret_cast<const char*>(pixels + y * row_pitch), row_size);
+    }
+    if ( ! file) {
+        throw std::runtime_error("Failed to write image " + path);
+    }
+}
@@ -0,0 +1,173 @@
+#include "Input.hpp"
+
+#include <algorithm>
+#include <thread>
+
+#include "Log.hpp"
+#include "Replay.hpp"
+
+// Longest a wait goes without pumping events.
+static const std::chrono::steady_clock::duration g_pump_interval =
+    std::chrono::microseconds(500);
+
+// Sleeping may overshoot by about this much, rest of a wait is spun.
+static const std::chrono::steady_clock::duration g_spin_duration =
+    std::chrono::microseconds(500);
+
+static std::int32_t
+map_scancode_to_game_key(SDL_Scancode scancode)
+{
+    switch (scancode) {
+    case SDL_SCANCODE_LEFT:
+        return GAME_KEY_LEFT;
+    case SDL_SCANCODE_RIGHT:
+        return GAME_KEY_RIGHT;
+    case SDL_SCANCODE_DOWN:
+        return GAME_KEY_SOFT_DROP;
+    case SDL_SCANCODE_SPACE:
+        return GAME_KEY_HARD_DROP;
+    case SDL_SCANCODE_UP:
+    case SDL_SCANCODE_X:
+        return GAME_KEY_ROTATE_CW;
+    case SDL_SCANCODE_Z:
+    case SDL_SCANCODE_LCTRL:
+        return GAME_KEY_ROTATE_CCW;
+    case SDL_SCANCODE_C:
+    case SDL_SCANCODE_LSHIFT:
+        return GAME_KEY_HOLD;
+    default:
+        return -1;
+    }
+}
+
+Input::Input() :
+    m_events(),
+    m_head(0),
+    m_tail(0),
+    m_dropped(0)
+{
+}
+
+void Input::start()
+{
+    SDL_AddEventWatch(on_event, this);
+}
+
+void Input::stop()
+{
+    SDL_DelEventWatch(on_event, this);
+
+    if (0 != dropped()) {
+        LOG_W("Dropped {} key transitions with input queue full", dropped());
+    }
+}
+
+int Input::on_event(void* userdata, SDL_Event* event)
+{
+    Input* input;
+    std::int32_t key;
+    std::uint32_t head;
+    struct InputEvent entry;
+
+    input = static_cast<Input*>(userdata);
+
+    if (SDL_KEYDOWN != event->type && SDL_KEYUP != event->type) {
+        return 0;
+    }
+
+    // Key repeat is handled by the simulation (DAS/ARR).
+    if (event->key.repeat) {
+        return 0;
+    }
+
+    key = map_scancode_to_game_key(event->key.keysym.scancode);
+    if (key < 0) {
+        return 0;
+    }
+
+    entry.time = std::chrono::steady_clock::now();
+    entry.key = key;
+    entry.pressed = SDL_KEYDOWN == event->type;
+
+    head = input->m_head.load(std::memory_order_relaxed);
+    if (head - input->m_tail.load(std::memory_order_acquire) >= INPUT_QUEUE_CAPACITY) {
+        input->m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
+
+    input->m_events[head & (INPUT_QUEUE_CAPACITY - 1)] = entry;
+    input->m_head.store(head + 1, std::memory_order_release);
+
+    return 0;
+}
+
+std::chrono::steady_clock::time_point Input::apply(
+        Game& game,
+        std::chrono::steady_clock::time_point tick_end,
+        std::chrono::steady_clock::duration tick_duration,
+        ReplayRecorder* recorder)
+{
+    std::uint32_t head;
+    std::uint32_t tail;
+    std::int64_t age;
+    std::chrono::steady_clock::time_point earliest_press;
+
+    head = m_head.load(std::memory_order_acquire);
+    tail = m_tail.load(std::memory_order_relaxed);
+    earliest_press = {};
+
+    for (; tail != head; tail++) {
+        const struct InputEvent& event = m_events[tail & (INPUT_QUEUE_CAPACITY - 1)];
+
+        if (event.time > tick_end) {
+            break;
+        }
+
+        // Transitions older than a tick got delayed, e.g. by the frame loop
+        // dropping time after a stall. Treat them as having just missed the
+        // previous tick.
+        age = std::min<std::int64_t>(
+                (tick_end - event.time).count(),
+                tick_duration.count() - 1);
+        age = age * GAME_SUBTICK_ONE / tick_duration.count();
+
+        game.set_key(event.key, event.pressed, static_cast<std::int32_t>(age));
+        if (nullptr != recorder) {
+            recorder->record_key(
+                    game,
+                    event.key,
+                    event.pressed,
+                    static_cast<std::int32_t>(age));
+        }
+
+        if (event.pressed && std::chrono::steady_clock::time_point() == earliest_press) {
+            earliest_press = event.time;
+        }
+    }
+
+    m_tail.store(tail, std::memory_order_release);
+
+    return earliest_press;
+}
+
+void input_wait_until(std::chrono::steady_clock::time_point deadline)
+{
+    std::chrono::steady_clock::duration remaining;
+
+    for (;;) {
+        SDL_PumpEvents();
+
+        remaining = deadline - std::chrono::steady_clock::now();
+        if (remaining <= std::chrono::steady_clock::duration::zero()) {
+            return;
+        }
+
+        if (remaining > g_spin_duration) {
+            std::this_thread::sleep_for(std::min(
+                        remaining - g_spin_duration,
+                        g_pump_interval));
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
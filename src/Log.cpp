@@ -1,36 +1,476 @@
 #include "Log.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
 
-void Log::w(std::string msg)
+#include <fcntl.h>
+#include <unistd.h>
+
+#define LOG_RING_CAPACITY 4096 // Power of two
+#define LOG_BATCH_SIZE 65536
+#define LOG_CRASH_BATCH_SIZE 4096
+
+/*
+ * Bounded multi-producer multi-consumer queue, see
+ * https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+ *
+ * Sequence numbers are stored relative to the cell index, so that the ring is
+ * ready for use when zero initialized and logging works during static
+ * initialization. Consumers are the writer thread and the crash handler.
+ */
+struct alignas(64) LogCell {
+    std::atomic<std::uint64_t> sequence;
+    LogRecord record;
+};
+
+// Output buffer of the consumer, written to fd when full.
+struct LogBatch {
+    char* data;
+    std::size_t used;
+    std::size_t capacity;
+    int fd;
+};
+
+static LogCell g_ring[LOG_RING_CAPACITY];
+alignas(64) static std::atomic<std::uint64_t> g_enqueue_position;
+alignas(64) static std::atomic<std::uint64_t> g_dequeue_position;
+static std::atomic<std::uint64_t> g_dropped;
+
+static std::atomic<const LogFormat*> g_formats[LOG_MAX_FORMATS];
+static std::atomic<std::uint32_t> g_format_count;
+
+// Only touched by the consumer. Formats written to the binary log so far.
+static bool g_format_written[LOG_MAX_FORMATS];
+static int g_binary_fd = -1;
+
+static std::atomic<bool> g_running;
+static std::atomic<bool> g_exit_handler_registered;
+static std::thread g_writer;
+static char g_batch[LOG_BATCH_SIZE];
+
+static const int g_crash_signals[] = { SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL };
+
+static std::int64_t
+now_ms(void)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static bool
+ring_push(
+        std::uint8_t level,
+        std::uint8_t type,
+        const void* data,
+        std::size_t size,
+        std::int64_t time_ms)
+{
+    std::uint64_t position;
+    std::uint64_t index;
+    std::int64_t difference;
+
+    LogCell* cell;
+
+    position = g_enqueue_position.load(std::memory_order_relaxed);
+    for (;;) {
+        index = position & (LOG_RING_CAPACITY - 1);
+        cell = &g_ring[index];
+        difference = static_cast<std::int64_t>(
+                cell->sequence.load(std::memory_order_acquire) + index - position);
+
+        if (0 == difference) {
+            if (g_enqueue_position.compare_exchange_weak(
+                        position,
+                        position + 1,
+                        std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            return false;
+        } else {
+            position = g_enqueue_position.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->record.time_ms = time_ms;
+    cell->record.length = static_cast<std::uint16_t>(
+            std::min(size, sizeof(cell->record.data)));
+    cell->record.type = type;
+    cell->record.level = level;
+    std::memcpy(cell->record.data, data, cell->record.length);
+
+    cell->sequence.store(position + 1 - index, std::memory_order_release);
+
+    return true;
+}
+
+static bool
+ring_pop(LogRecord& record)
+{
+    std::uint64_t position;
+    std::uint64_t index;
+    std::int64_t difference;
+
+    LogCell* cell;
+
+    position = g_dequeue_position.load(std::memory_order_relaxed);
+    for (;;) {
+        index = position & (LOG_RING_CAPACITY - 1);
+        cell = &g_ring[index];
+        difference = static_cast<std::int64_t>(
+                cell->sequence.load(std::memory_order_acquire) + index - (position + 1));
+
+        if (0 == difference) {
+            if (g_dequeue_position.compare_exchange_weak(
+                        position,
+                        position + 1,
+                        std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            return false;
+        } else {
+            position = g_dequeue_position.load(std::memory_order_relaxed);
+        }
+    }
+
+    std::memcpy(&record, &cell->record, LOG_RECORD_HEADER_SIZE + cell->record.length);
+
+    cell->sequence.store(position + LOG_RING_CAPACITY - index, std::memory_order_release);
+
+    return true;
+}
+
+static void
+write_all(int fd, const char* data, std::size_t size)
+{
+    ssize_t written;
+
+    while (0 != size) {
+        written = ::write(fd, data, size);
+        if (written <= 0) {
+            return;
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+}
+
+static void
+batch_flush(LogBatch& batch)
+{
+    write_all(batch.fd, batch.data, batch.used);
+    batch.used = 0;
+}
+
+static void
+batch_append(LogBatch& batch, const void* data, std::size_t size)
+{
+    if (batch.capacity - batch.used < size) {
+        batch_flush(batch);
+    }
+
+    if (size > batch.capacity) {
+        write_all(batch.fd, static_cast<const char*>(data), size);
+        return;
+    }
+
+    std::memcpy(&batch.data[batch.used], data, size);
+    batch.used += size;
+}
+
+static const LogFormat*
+find_format(const LogRecord& record)
 {
-    std::string warn = WARN + msg;
-    Log::log(warn);
+    std::uint32_t id;
+
+    id = log_record_format_id(record);
+    if (id >= LOG_MAX_FORMATS) {
+        return nullptr;
+    }
+
+    return g_formats[id].load(std::memory_order_acquire);
 }
 
-void Log::i(std::string msg)
+static void
+emit_binary_format(LogBatch& batch, const LogFormat& format)
 {
-    std::string info = INFO + msg;
-    Log::log(info);
+    std::uint8_t entry;
+    std::uint32_t id;
+    std::uint8_t level;
+    std::uint16_t length;
+
+    entry = LOG_ENTRY_FORMAT;
+    id = format.id();
+    level = format.level();
+    length = static_cast<std::uint16_t>(std::strlen(format.format()));
+
+    batch_append(batch, &entry, sizeof(entry));
+    batch_append(batch, &id, sizeof(id));
+    batch_append(batch, &level, sizeof(level));
+    batch_append(batch, &length, sizeof(length));
+    batch_append(batch, format.format(), length);
 }
 
-void Log::e(std::string msg)
+/*
+ * Writing binary records is async-signal-safe. Formatting text is too, except
+ * for floating point arguments which go through snprintf, so a crash while
+ * logging text with those may still deadlock in the crash handler.
+ */
+static void
+emit(LogBatch& batch, const LogRecord& record)
 {
-    std::string error = ERR + msg;
-    Log::log(error);
+    char line[LOG_LINE_MAX];
+    std::uint8_t entry;
+    const LogFormat* format;
+
+    format = LOG_RECORD_ARGS == record.type ? find_format(record) : nullptr;
+
+    if (-1 == g_binary_fd) {
+        batch_append(
+                batch,
+                line,
+                log_format_line(record, nullptr == format ? nullptr : format->format(), line));
+        return;
+    }
+
+    if (nullptr != format && ! g_format_written[format->id()]) {
+        emit_binary_format(batch, *format);
+        g_format_written[format->id()] = true;
+    }
+
+    entry = LOG_ENTRY_RECORD;
+    batch_append(batch, &entry, sizeof(entry));
+    batch_append(batch, &record, LOG_RECORD_HEADER_SIZE + record.length);
 }
 
-void Log::d(std::string msg)
+// Formatted by hand rather than with snprintf, as the crash handler calls
+// this as well.
+static void
+emit_dropped(LogBatch& batch, std::uint64_t dropped)
 {
-    std::string debug = DBG + msg;
-    Log::log(debug);
+    static const char prefix[] = "Log ring full, dropped ";
+    static const char suffix[] = " messages";
+
+    LogRecord record;
+    char digits[20];
+    std::size_t digit_count;
+    std::size_t length;
+
+    digit_count = 0;
+    do {
+        digits[digit_count++] = static_cast<char>('0' + dropped % 10);
+        dropped /= 10;
+    } while (0 != dropped);
+
+    length = 0;
+    std::memcpy(record.data, prefix, sizeof(prefix) - 1);
+    length += sizeof(prefix) - 1;
+    while (digit_count > 0) {
+        record.data[length++] = static_cast<std::uint8_t>(digits[--digit_count]);
+    }
+    std::memcpy(record.data + length, suffix, sizeof(suffix) - 1);
+    length += sizeof(suffix) - 1;
+
+    record.time_ms = now_ms();
+    record.type = LOG_RECORD_TEXT;
+    record.level = LOG_LEVEL_WARN;
+    record.length = static_cast<std::uint16_t>(length);
+
+    emit(batch, record);
 }
 
-void Log::log(std::string msg)
+/*
+ * Writes out everything in the ring without touching iostreams, so that the
+ * crash handler may call it. Returns number of records written.
+ */
+static std::size_t
+drain_ring(char* buffer, std::size_t buffer_size)
 {
-    auto currentTime = std::chrono::system_clock::now();
-    auto currentTimeMillis =
-        std::chrono::duration_cast<std::chrono::milliseconds>(currentTime.time_since_epoch());
+    LogRecord record;
+    LogBatch batch;
+    std::size_t count;
+    std::uint64_t dropped;
+
+    batch.data = buffer;
+    batch.used = 0;
+    batch.capacity = buffer_size;
+    batch.fd = -1 == g_binary_fd ? STDOUT_FILENO : g_binary_fd;
+    count = 0;
 
-    std::cout << currentTimeMillis.count() << " " << msg << std::endl;
+    dropped = g_dropped.exchange(0, std::memory_order_relaxed);
+    if (0 != dropped) {
+        emit_dropped(batch, dropped);
+    }
+
+    while (ring_pop(record)) {
+        emit(batch, record);
+        count++;
+    }
+
+    batch_flush(batch);
+
+    return count;
+}
+
+// Returns number of records written.
+static std::size_t
+drain(char* buffer, std::size_t buffer_size)
+{
+    if (-1 == g_binary_fd) {
+        // Anything written through std::cout must come out before this batch.
+        std::cout.flush();
+    }
+
+    return drain_ring(buffer, buffer_size);
+}
+
+static void
+writer_main(void)
+{
+    // Producers do not signal the writer, polling keeps the hot path free
+    // of any system calls.
+    while (g_running.load(std::memory_order_acquire)) {
+        if (0 == drain(g_batch, sizeof(g_batch))) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+
+    drain(g_batch, sizeof(g_batch));
+}
+
+static void
+crash_handler(int signal_number)
+{
+    char buffer[LOG_CRASH_BATCH_SIZE];
+
+    // Flushing std::cout is not safe here, it may be what crashed.
+    drain_ring(buffer, sizeof(buffer));
+
+    std::signal(signal_number, SIG_DFL);
+    std::raise(signal_number);
+}
+
+LogFormat::LogFormat(std::uint8_t level, const char* format) :
+    m_id(0),
+    m_level(level),
+    m_format(format)
+{
+    m_id = Log::register_format(this);
+}
+
+std::uint32_t Log::register_format(const LogFormat* format)
+{
+    std::uint32_t id;
+
+    id = g_format_count.fetch_add(1, std::memory_order_relaxed);
+    if (id < LOG_MAX_FORMATS) {
+        g_formats[id].store(format, std::memory_order_release);
+    }
+
+    return id;
+}
+
+void Log::start(const std::string& binary_path)
+{
+    if (g_running.load()) {
+        return;
+    }
+
+    if ( ! binary_path.empty()) {
+        g_binary_fd = ::open(
+                binary_path.c_str(),
+                O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                0644);
+        if (-1 == g_binary_fd) {
+            throw std::runtime_error("Failed to open binary log " + binary_path);
+        }
+        write_all(g_binary_fd, LOG_BINARY_MAGIC, LOG_BINARY_MAGIC_SIZE);
+    }
+
+    for (int signal_number : g_crash_signals) {
+        std::signal(signal_number, crash_handler);
+    }
+
+    g_running.store(true);
+    g_writer = std::thread(writer_main);
+
+    // Also drain on std::exit(), a joinable thread may not be destroyed.
+    if ( ! g_exit_handler_registered.exchange(true)) {
+        std::atexit(Log::stop);
+    }
+}
+
+void Log::stop()
+{
+    if (g_running.exchange(false)) {
+        g_writer.join();
+
+        for (int signal_number : g_crash_signals) {
+            std::signal(signal_number, SIG_DFL);
+        }
+    } else {
+        // Never started, write out whatever was logged meanwhile.
+        drain(g_batch, sizeof(g_batch));
+    }
+
+    if (-1 != g_binary_fd) {
+        ::close(g_binary_fd);
+        g_binary_fd = -1;
+    }
+}
+
+void Log::w(std::string_view msg)
+{
+    if ( ! Log::enabled(LOG_LEVEL_WARN)) {
+        return;
+    }
+
+    Log::push(LOG_LEVEL_WARN, LOG_RECORD_TEXT, msg.data(), msg.size());
+}
+
+void Log::i(std::string_view msg)
+{
+    if ( ! Log::enabled(LOG_LEVEL_INFO)) {
+        return;
+    }
+
+    Log::push(LOG_LEVEL_INFO, LOG_RECORD_TEXT, msg.data(), msg.size());
+}
+
+void Log::e(std::string_view msg)
+{
+    if ( ! Log::enabled(LOG_LEVEL_ERROR)) {
+        return;
+    }
+
+    Log::push(LOG_LEVEL_ERROR, LOG_RECORD_TEXT, msg.data(), msg.size());
+}
+
+void Log::d(std::string_view msg)
+{
+    if ( ! Log::enabled(LOG_LEVEL_DEBUG)) {
+        return;
+    }
+
+    Log::push(LOG_LEVEL_DEBUG, LOG_RECORD_TEXT, msg.data(), msg.size());
+}
+
+void Log::push(
+        std::uint8_t level,
+        std::uint8_t type,
+        const void* data,
+        std::size_t size)
+{
+    if ( ! ring_push(level, type, data, size, now_ms())) {
+        g_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
 }
@@ -0,0 +1,192 @@
+#include "LogRecord.hpp"
+
+#include <cstdio>
+
+const char* const g_log_level_prefixes[LOG_LEVEL_COUNT] = { DBG, INFO, WARN, ERR };
+
+// Appends to a line, leaving room for the newline. Truncates silently.
+class LineWriter
+{
+public:
+    explicit LineWriter(char* out) :
+        m_out(out),
+        m_used(0)
+    {
+    }
+
+    std::size_t used() const { return m_used; }
+
+    void append(const char* text, std::size_t size)
+    {
+        size = std::min(size, LOG_LINE_MAX - 1 - m_used);
+        std::memcpy(&m_out[m_used], text, size);
+        m_used += size;
+    }
+
+    void append_unsigned(std::uint64_t value, bool negative)
+    {
+        char digits[21];
+        std::size_t count;
+
+        count = 0;
+        do {
+            digits[sizeof(digits) - 1 - count++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (0 != value);
+
+        if (negative) {
+            digits[sizeof(digits) - 1 - count++] = '-';
+        }
+
+        append(&digits[sizeof(digits) - count], count);
+    }
+
+    void append_signed(std::int64_t value)
+    {
+        // Negate in unsigned, so that the most negative value works as well.
+        append_unsigned(
+                value < 0 ?
+                    0 - static_cast<std::uint64_t>(value) :
+                    static_cast<std::uint64_t>(value),
+                value < 0);
+    }
+
+    void finish()
+    {
+        m_out[m_used++] = '\n';
+    }
+
+private:
+    char* m_out;
+    std::size_t m_used;
+};
+
+// Returns number of argument bytes consumed, zero when malformed.
+static std::size_t
+append_arg(LineWriter& line, const std::uint8_t* data, std::size_t size)
+{
+    std::int32_t i32;
+    std::uint32_t u32;
+    std::int64_t i64;
+    std::uint64_t u64;
+    double f64;
+    std::uint16_t length;
+    char buffer[32];
+
+    if (0 == size) {
+        return 0;
+    }
+
+    switch (data[0]) {
+    case LOG_ARG_I32:
+        if (size < 1 + sizeof(i32)) {
+            return 0;
+        }
+        std::memcpy(&i32, &data[1], sizeof(i32));
+        line.append_signed(i32);
+        return 1 + sizeof(i32);
+    case LOG_ARG_U32:
+        if (size < 1 + sizeof(u32)) {
+            return 0;
+        }
+        std::memcpy(&u32, &data[1], sizeof(u32));
+        line.append_unsigned(u32, false);
+        return 1 + sizeof(u32);
+    case LOG_ARG_I64:
+        if (size < 1 + sizeof(i64)) {
+            return 0;
+        }
+        std::memcpy(&i64, &data[1], sizeof(i64));
+        line.append_signed(i64);
+        return 1 + sizeof(i64);
+    case LOG_ARG_U64:
+        if (size < 1 + sizeof(u64)) {
+            return 0;
+        }
+        std::memcpy(&u64, &data[1], sizeof(u64));
+        line.append_unsigned(u64, false);
+        return 1 + sizeof(u64);
+    case LOG_ARG_F64:
+        if (size < 1 + sizeof(f64)) {
+            return 0;
+        }
+        std::memcpy(&f64, &data[1], sizeof(f64));
+        line.append(buffer, std::min<std::size_t>(
+                    std::snprintf(buffer, sizeof(buffer), "%.6g", f64),
+                    sizeof(buffer) - 1));
+        return 1 + sizeof(f64);
+    case LOG_ARG_STRING:
+        if (size < 1 + sizeof(length)) {
+            return 0;
+        }
+        std::memcpy(&length, &data[1], sizeof(length));
+        if (size < 1 + sizeof(length) + length) {
+            return 0;
+        }
+        line.append(reinterpret_cast<const char*>(&data[1 + sizeof(length)]), length);
+        return 1 + sizeof(length) + length;
+    default:
+        return 0;
+    }
+}
+
+static void
+append_args(LineWriter& line, const LogRecord& record, const char* format)
+{
+    const std::uint8_t* args;
+    std::size_t size;
+    std::size_t consumed;
+    const char* placeholder;
+
+    args = &record.data[sizeof(std::uint32_t)];
+    size = record.length - sizeof(std::uint32_t);
+
+    if (nullptr == format) {
+        line.append("<unknown format>", 16);
+        format = "";
+    }
+
+    // Each {} is replaced by the next argument, arguments running out leave
+    // the remaining placeholders as they are.
+    for (;;) {
+        placeholder = std::strstr(format, "{}");
+        if (nullptr == placeholder) {
+            line.append(format, std::strlen(format));
+            return;
+        }
+
+        line.append(format, placeholder - format);
+        format = placeholder + 2;
+
+        consumed = append_arg(line, args, size);
+        if (0 == consumed) {
+            line.append("{}", 2);
+        }
+        args += consumed;
+        size -= consumed;
+    }
+}
+
+std::size_t
+log_format_line(const LogRecord& record, const char* format, char* out)
+{
+    LineWriter line(out);
+
+    line.append_signed(record.time_ms);
+    line.append(" ", 1);
+    if (record.level < LOG_LEVEL_COUNT) {
+        line.append(g_log_level_prefixes[record.level], 4);
+    }
+
+    if (LOG_RECORD_ARGS == record.type && record.length >= sizeof(std::uint32_t)) {
+        append_args(line, record, format);
+    } else {
+        line.append(
+                reinterpret_cast<const char*>(record.data),
+                std::min<std::size_t>(record.length, sizeof(record.data)));
+    }
+
+    line.finish();
+
+    return line.used();
+}
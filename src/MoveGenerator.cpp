@@ -0,0 +1,504 @@
+#include "MoveGenerator.hpp"
+
+#include <algorithm>
+
+struct PieceCells {
+    std::int8_t row[4];
+    std::int8_t column[4];
+};
+
+// Placement (rotation r, x, y) covers the same cells as (rotation, x + dx, y + dy).
+struct Equivalent {
+    std::int8_t rotation;
+    std::int8_t dx;
+    std::int8_t dy;
+};
+
+typedef std::array<std::array<PieceCells, TETROMINO_ROTATION_COUNT>, TETROMINO_COUNT> CellTable;
+typedef std::array<std::array<Equivalent, TETROMINO_ROTATION_COUNT>, TETROMINO_COUNT> EquivalentTable;
+
+constexpr CellTable
+make_cell_table()
+{
+    CellTable table = {};
+
+    for (std::int32_t type = 0; type < TETROMINO_COUNT; type++) {
+        for (std::int32_t r = 0; r < TETROMINO_ROTATION_COUNT; r++) {
+            std::int32_t count = 0;
+
+            for (std::int32_t i = 0; i < BOARD_PIECE_ROWS; i++) {
+                for (std::int32_t column = 0; column < BOARD_PIECE_ROWS; column++) {
+                    if (g_tetromino_rotations[type][r].rows[i] & (1u << column)) {
+                        table[type][r].row[count] = static_cast<std::int8_t>(i);
+                        table[type][r].column[count] = static_cast<std::int8_t>(column);
+                        count++;
+                    }
+                }
+            }
+        }
+    }
+
+    return table;
+}
+
+// Shape moved to the bottom left corner of the piece box.
+constexpr PieceRows
+normalize(const PieceRows& piece, std::int32_t& min_column, std::int32_t& min_row)
+{
+    PieceRows normalized = {};
+    std::uint32_t columns = 0;
+
+    min_row = 0;
+    while (0 == piece.rows[min_row]) {
+        min_row++;
+    }
+
+    for (std::int32_t i = 0; i < BOARD_PIECE_ROWS; i++) {
+        columns |= piece.rows[i];
+    }
+    min_column = 0;
+    while (0 == (columns & (1u << min_column))) {
+        min_column++;
+    }
+
+    for (std::int32_t i = min_row; i < BOARD_PIECE_ROWS; i++) {
+        normalized.rows[i - min_row] = static_cast<std::uint16_t>(piece.rows[i] >> min_column);
+    }
+
+    return normalized;
+}
+
+constexpr EquivalentTable
+make_equivalent_table()
+{
+    EquivalentTable table = {};
+
+    for (std::int32_t type = 0; type < TETROMINO_COUNT; type++) {
+        for (std::int32_t r = 0; r < TETROMINO_ROTATION_COUNT; r++) {
+            std::int32_t column = 0;
+            std::int32_t row = 0;
+            std::int32_t other_column = 0;
+            std::int32_t other_row = 0;
+            PieceRows shape = normalize(g_tetromino_rotations[type][r], column, row);
+
+            table[type][r] = { static_cast<std::int8_t>(r), 0, 0 };
+
+            for (std::int32_t other = 0; other < r; other++) {
+                PieceRows other_shape = normalize(
+                        g_tetromino_rotations[type][other],
+                        other_column,
+                        other_row);
+                bool same = true;
+
+                for (std::int32_t i = 0; i < BOARD_PIECE_ROWS; i++) {
+                    same = same && shape.rows[i] == other_shape.rows[i];
+                }
+
+                if (same) {
+                    table[type][r] = {
+                        static_cast<std::int8_t>(other),
+                        static_cast<std::int8_t>(column - other_column),
+                        static_cast<std::int8_t>(row - other_row),
+                    };
+                    break;
+                }
+            }
+        }
+    }
+
+    return table;
+}
+
+// Free positions of every rotation at rows clear of the stack, where only the
+// walls are in the way.
+constexpr std::array<std::array<std::uint16_t, TETROMINO_ROTATION_COUNT>, TETROMINO_COUNT>
+make_open_free_table(const CellTable& cells)
+{
+    std::array<std::array<std::uint16_t, TETROMINO_ROTATION_COUNT>, TETROMINO_COUNT> table = {};
+
+    for (std::int32_t type = 0; type < TETROMINO_COUNT; type++) {
+        for (std::int32_t r = 0; r < TETROMINO_ROTATION_COUNT; r++) {
+            std::uint32_t collision = 0;
+
+            for (std::int32_t k = 0; k < 4; k++) {
+                collision |= (0xFFFF0000u | g_board_row_empty) >> cells[type][r].column[k];
+            }
+            table[type][r] = static_cast<std::uint16_t>(~collision);
+        }
+    }
+
+    return table;
+}
+
+constexpr CellTable g_cells = make_cell_table();
+constexpr EquivalentTable g_equivalents = make_equivalent_table();
+constexpr std::array<std::array<std::uint16_t, TETROMINO_ROTATION_COUNT>, TETROMINO_COUNT>
+    g_open_free = make_open_free_table(g_cells);
+
+// Whether clear of the stack every rotation succeeds without moving the piece
+// vertically, so that what is reachable there does not depend on the row.
+constexpr bool
+open_kicks_keep_row()
+{
+    for (std::int32_t type = 0; type < TETROMINO_COUNT; type++) {
+        for (std::int32_t r = 0; r < TETROMINO_ROTATION_COUNT; r++) {
+            for (std::int32_t direction = 0; direction < ROTATE_DIRECTION_COUNT; direction++) {
+                std::int32_t target = (r + (ROTATE_CW == direction ? 1 : 3)) & 3;
+
+                for (std::int32_t column = 0; column < 16; column++) {
+                    std::int32_t k = 0;
+
+                    if (0 == (g_open_free[type][r] & (1u << column))) {
+                        continue;
+                    }
+
+                    while (k < TETROMINO_KICK_COUNT) {
+                        std::int32_t kicked = column + g_tetromino_kicks[type][r][direction][k].x;
+
+                        if (0 <= kicked && kicked < 16 &&
+                                (g_open_free[type][target] & (1u << kicked))) {
+                            break;
+                        }
+                        k++;
+                    }
+
+                    if (TETROMINO_KICK_COUNT == k ||
+                            0 != g_tetromino_kicks[type][r][direction][k].y) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+static_assert(open_kicks_keep_row(), "Collapsing rows clear of the stack relies on this");
+
+static_assert(ROTATION_SPAWN == g_equivalents[TETROMINO_I][ROTATION_180].rotation &&
+        0 == g_equivalents[TETROMINO_I][ROTATION_180].dx &&
+        -1 == g_equivalents[TETROMINO_I][ROTATION_180].dy,
+        "I 180 state is spawn state one row lower");
+static_assert(ROTATION_SPAWN == g_equivalents[TETROMINO_O][ROTATION_LEFT].rotation,
+        "O has one shape");
+static_assert(ROTATION_LEFT == g_equivalents[TETROMINO_T][ROTATION_LEFT].rotation,
+        "T has four shapes");
+
+// Bit b of the result is bit b + dx of mask.
+static inline std::uint16_t
+shift_mask(std::uint32_t mask, std::int32_t dx)
+{
+    return static_cast<std::uint16_t>(dx >= 0 ? mask >> dx : mask << -dx);
+}
+
+// Spreads reached bits sideways through runs of free bits, as repeated shifting would.
+static inline std::uint32_t
+fill_row(std::uint32_t reached, std::uint32_t free)
+{
+    std::uint32_t left;
+    std::uint32_t right;
+
+    left = free;
+    reached |= left & (reached << 1);
+    left &= left << 1;
+    reached |= left & (reached << 2);
+    left &= left << 2;
+    reached |= left & (reached << 4);
+    left &= left << 4;
+    reached |= left & (reached << 8);
+
+    right = free;
+    reached |= right & (reached >> 1);
+    right &= right >> 1;
+    reached |= right & (reached >> 2);
+    right &= right >> 2;
+    reached |= right & (reached >> 4);
+    right &= right >> 4;
+    reached |= right & (reached >> 8);
+
+    return reached & 0xFFFF;
+}
+
+// Whether free rows from i up to i + 5 are all the same, which covers every
+// kick from rows i + 2 and i + 3.
+static inline bool
+uniform_rows(std::uint64_t uniform, std::int32_t i)
+{
+    return 0x1F == ((uniform >> i) & 0x1F);
+}
+
+MoveGenerator::MoveGenerator()
+{
+    for (std::int32_t r = 0; r < TETROMINO_ROTATION_COUNT; r++) {
+        m_reached[r].fill(0);
+        m_pending[r].fill(0);
+        m_fresh[r].fill(0);
+    }
+}
+
+ActivePiece MoveGenerator::spawn(std::int32_t type)
+{
+    ActivePiece piece;
+
+    piece.type = type;
+    piece.rotation = ROTATION_SPAWN;
+    piece.x = TETROMINO_SPAWN_X;
+    piece.y = g_tetromino_spawn_y[type];
+
+    return piece;
+}
+
+std::uint32_t MoveGenerator::generate(
+        const Board& board,
+        const ActivePiece& start,
+        PlacementList& placements)
+{
+    std::int32_t type;
+    std::int32_t stack_top;
+    std::int32_t open;
+    std::int32_t top;
+    std::int32_t target;
+    std::int32_t target_row;
+    std::int32_t pending_top[TETROMINO_ROTATION_COUNT];
+    std::int32_t pending_bottom[TETROMINO_ROTATION_COUNT];
+    std::int32_t fresh_top[TETROMINO_ROTATION_COUNT];
+    std::int32_t fresh_bottom[TETROMINO_ROTATION_COUNT];
+    std::uint32_t collision;
+    std::uint32_t above;
+    std::uint32_t row;
+    std::uint32_t incoming;
+    std::uint32_t fresh;
+    std::uint32_t candidates;
+    std::uint32_t kicked;
+    std::uint32_t grounded;
+    std::uint32_t column;
+    bool changed;
+
+    type = start.type;
+    placements.count = 0;
+
+    if (board.collides(tetromino_rows(type, start.rotation), start.x, start.y)) {
+        return 0;
+    }
+
+    stack_top = BOARD_HEIGHT - 1;
+    while (stack_top >= 0 && g_board_row_empty == board.row(stack_top)) {
+        stack_top--;
+    }
+
+    // Lowest row at which no piece box overlaps the stack.
+    open = stack_top + 1 + BOARD_FLOOR_ROWS;
+
+    for (std::int32_t r = 0; r < TETROMINO_ROTATION_COUNT; r++) {
+        const PieceCells& cells = g_cells[type][r];
+        std::int32_t i;
+
+        for (i = 0; i < open; i++) {
+            // Bits shifted in from above the row are wall.
+            collision = 0;
+            for (std::int32_t k = 0; k < 4; k++) {
+                collision |= (0xFFFF0000u | board.row(i - BOARD_FLOOR_ROWS + cells.row[k])) >>
+                    cells.column[k];
+            }
+            m_free[r][i] = static_cast<std::uint16_t>(~collision);
+        }
+
+        std::fill(m_free[r].begin() + open, m_free[r].end(), g_open_free[type][r]);
+
+        m_uniform[r] = (~0ull << open) & ((1ull << (MOVE_GENERATOR_ROWS - 1)) - 1);
+        for (i = 0; i < open; i++) {
+            m_uniform[r] |= static_cast<std::uint64_t>(m_free[r][i] == m_free[r][i + 1]) << i;
+        }
+
+        pending_top[r] = -1;
+    }
+
+    top = start.y + BOARD_FLOOR_ROWS;
+
+    if (top < open + 2) {
+        m_pending[start.rotation][top] =
+            static_cast<std::uint16_t>(1u << (start.x + BOARD_WALL_LEFT));
+        pending_top[start.rotation] = top;
+        pending_bottom[start.rotation] = top;
+    } else {
+        // Clear of the stack rows are alike and rotations keep the row, so
+        // everything reachable there is reachable at the start row by
+        // shifting and rotating alone, and drops down as is. Searching rows
+        // one by one starts from two rows above the stack, the most a kick
+        // moves downwards.
+        std::uint32_t air[TETROMINO_ROTATION_COUNT] = {};
+
+        air[start.rotation] = 1u << (start.x + BOARD_WALL_LEFT);
+
+        do {
+            changed = false;
+            for (std::int32_t r = 0; r < TETROMINO_ROTATION_COUNT; r++) {
+                air[r] = fill_row(air[r], g_open_free[type][r]);
+
+                for (std::int32_t direction = 0; direction < ROTATE_DIRECTION_COUNT; direction++) {
+                    const std::array<Kick, TETROMINO_KICK_COUNT>& kicks =
+                        g_tetromino_kicks[type][r][direction];
+
+                    target = (r + (ROTATE_CW == direction ? 1 : 3)) & 3;
+                    candidates = air[r];
+
+                    for (std::int32_t k = 0; k < TETROMINO_KICK_COUNT && 0 != candidates; k++) {
+                        kicked = candidates & shift_mask(g_open_free[type][target], kicks[k].x);
+                        candidates &= ~kicked;
+
+                        row = shift_mask(kicked, -kicks[k].x) & ~air[target];
+                        if (0 != row) {
+                            air[target] |= row;
+                            changed = true;
+                        }
+                    }
+                }
+            }
+        } while (changed);
+
+        top = open + 2;
+        for (std::int32_t r = 0; r < TETROMINO_ROTATION_COUNT; r++) {
+            if (0 != air[r]) {
+                m_pending[r][top] = static_cast<std::uint16_t>(air[r]);
+                pending_top[r] = top;
+                pending_bottom[r] = top;
+            }
+        }
+    }
+
+    do {
+        // Shifts and soft drops. Rows are visited top down, so that one sweep
+        // reaches everything below. A row is only filled when something new
+        // enters it, either from above or pending from a rotation, and the
+        // sweep ends once that stops happening.
+        for (std::int32_t r = 0; r < TETROMINO_ROTATION_COUNT; r++) {
+            fresh_top[r] = -1;
+            fresh_bottom[r] = 0;
+            if (pending_top[r] < 0) {
+                continue;
+            }
+
+            above = 0;
+            for (std::int32_t i = pending_top[r]; i >= 0; i--) {
+                row = m_reached[r][i];
+                incoming = ((above & m_free[r][i]) | m_pending[r][i]) & ~row;
+                m_pending[r][i] = 0;
+
+                if (0 != incoming) {
+                    // Clear of the stack everything fits, nothing to spread.
+                    fresh = m_free[r][i] == (above & m_free[r][i]) ?
+                        m_free[r][i] :
+                        fill_row(row | incoming, m_free[r][i]);
+                    m_fresh[r][i] = static_cast<std::uint16_t>(fresh & ~row);
+                    row = fresh;
+                    m_reached[r][i] = static_cast<std::uint16_t>(row);
+
+                    if (fresh_top[r] < 0) {
+                        fresh_top[r] = i;
+                    }
+                    fresh_bottom[r] = i;
+                } else if (i < pending_bottom[r]) {
+                    break;
+                }
+
+                above = row;
+            }
+
+            pending_top[r] = -1;
+        }
+
+        // Rotations of the states reached by the sweep. A kick applies to the
+        // states for which every earlier kick collided.
+        changed = false;
+        for (std::int32_t r = 0; r < TETROMINO_ROTATION_COUNT; r++) {
+            for (std::int32_t i = fresh_top[r]; i >= fresh_bottom[r]; i--) {
+                fresh = m_fresh[r][i];
+                if (0 == fresh) {
+                    continue;
+                }
+                m_fresh[r][i] = 0;
+
+                // Where the rows kicks test look the same as for the row
+                // above, rotating gives what rotating there gave, one row
+                // lower. Dropping gets there as well.
+                if (i >= 2 &&
+                        uniform_rows(m_uniform[(r + 1) & 3], i - 2) &&
+                        uniform_rows(m_uniform[(r + 3) & 3], i - 2)) {
+                    fresh &= ~m_reached[r][i + 1];
+                    if (0 == fresh) {
+                        continue;
+                    }
+                }
+
+                for (std::int32_t direction = 0; direction < ROTATE_DIRECTION_COUNT; direction++) {
+                    const std::array<Kick, TETROMINO_KICK_COUNT>& kicks =
+                        g_tetromino_kicks[type][r][direction];
+
+                    target = (r + (ROTATE_CW == direction ? 1 : 3)) & 3;
+                    candidates = fresh;
+
+                    for (std::int32_t k = 0; k < TETROMINO_KICK_COUNT && 0 != candidates; k++) {
+                        target_row = i + kicks[k].y;
+                        if (target_row < 0 || target_row >= MOVE_GENERATOR_ROWS) {
+                            continue;
+                        }
+
+                        kicked = candidates & shift_mask(m_free[target][target_row], kicks[k].x);
+                        candidates &= ~kicked;
+
+                        row = shift_mask(kicked, -kicks[k].x) & ~m_reached[target][target_row];
+                        if (0 == row) {
+                            continue;
+                        }
+
+                        m_pending[target][target_row] |= static_cast<std::uint16_t>(row);
+                        if (pending_top[target] < 0) {
+                            pending_top[target] = target_row;
+                            pending_bottom[target] = target_row;
+                        } else {
+                            pending_top[target] = std::max(pending_top[target], target_row);
+                            pending_bottom[target] = std::min(pending_bottom[target], target_row);
+                        }
+                        top = std::max(top, target_row);
+                        changed = true;
+                    }
+                }
+            }
+        }
+    } while (changed);
+
+    for (std::int32_t r = 0; r < TETROMINO_ROTATION_COUNT; r++) {
+        const Equivalent& equivalent = g_equivalents[type][r];
+
+        for (std::int32_t i = 0; i <= top; i++) {
+            grounded = m_reached[r][i] & ~(0 == i ? 0u : m_free[r][i - 1]);
+
+            // Drop what an earlier rotation already covers.
+            target_row = i + equivalent.dy;
+            if (r != equivalent.rotation && 0 <= target_row && target_row <= top) {
+                row = m_reached[equivalent.rotation][target_row] &
+                    ~(0 == target_row ? 0u : m_free[equivalent.rotation][target_row - 1]);
+                grounded &= ~static_cast<std::uint32_t>(shift_mask(row, equivalent.dx));
+            }
+
+            while (grounded) {
+                column = __builtin_ctz(grounded);
+                grounded &= grounded - 1;
+
+                placements.placements[placements.count++] = {
+                    static_cast<std::int8_t>(r),
+                    static_cast<std::int8_t>(column - BOARD_WALL_LEFT),
+                    static_cast<std::int8_t>(i - BOARD_FLOOR_ROWS),
+                };
+            }
+        }
+    }
+
+    // Sweeps and rotations leave nothing pending or fresh behind.
+    for (std::int32_t r = 0; r < TETROMINO_ROTATION_COUNT; r++) {
+        std::fill(m_reached[r].begin(), m_reached[r].begin() + top + 1, 0);
+    }
+
+    return placements.count;
+}
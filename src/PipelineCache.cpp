@@ -0,0 +1,261 @@
+#include "PipelineCache.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include "Log.hpp"
+
+#define PIPELINE_CACHE_MAGIC 0x4350544E // "NTPC"
+#define PIPELINE_CACHE_FORMAT_VERSION 1
+
+/*
+ * Written in front of the data returned by vkGetPipelineCacheData. Vulkan's
+ * own header identifies the device, but not the driver version.
+ */
+struct PipelineCacheFileHeader {
+    std::uint32_t magic;
+    std::uint32_t format_version;
+    std::uint32_t vendor_id;
+    std::uint32_t device_id;
+    std::uint32_t driver_version;
+    std::uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+    std::uint64_t data_size;
+};
+
+static std::string
+get_cache_path(void)
+{
+    const char* xdg_cache_home;
+    const char* home;
+
+    xdg_cache_home = std::getenv("XDG_CACHE_HOME");
+    if (nullptr != xdg_cache_home && '\0' != xdg_cache_home[0]) {
+        return std::string(xdg_cache_home) + "/neotetris/pipeline_cache.bin";
+    }
+
+    home = std::getenv("HOME");
+    if (nullptr != home && '\0' != home[0]) {
+        return std::string(home) + "/.cache/neotetris/pipeline_cache.bin";
+    }
+
+    return "";
+}
+
+static bool
+header_matches(
+        const struct PipelineCacheFileHeader& header,
+        const VkPhysicalDeviceProperties& properties)
+{
+    return PIPELINE_CACHE_MAGIC == header.magic &&
+        PIPELINE_CACHE_FORMAT_VERSION == header.format_version &&
+        properties.vendorID == header.vendor_id &&
+        properties.deviceID == header.device_id &&
+        properties.driverVersion == header.driver_version &&
+        0 == std::memcmp(
+                properties.pipelineCacheUUID,
+                header.pipeline_cache_uuid,
+                VK_UUID_SIZE);
+}
+
+static bool
+vulkan_header_matches(
+        const std::vector<char>& data,
+        const VkPhysicalDeviceProperties& properties)
+{
+    VkPipelineCacheHeaderVersionOne vulkan_header;
+
+    if (data.size() < sizeof(vulkan_header)) {
+        return false;
+    }
+
+    std::memcpy(&vulkan_header, data.data(), sizeof(vulkan_header));
+
+    return vulkan_header.headerSize >= sizeof(vulkan_header) &&
+        VK_PIPELINE_CACHE_HEADER_VERSION_ONE == vulkan_header.headerVersion &&
+        properties.vendorID == vulkan_header.vendorID &&
+        properties.deviceID == vulkan_header.deviceID &&
+        0 == std::memcmp(
+                properties.pipelineCacheUUID,
+                vulkan_header.pipelineCacheUUID,
+                VK_UUID_SIZE);
+}
+
+static std::vector<char>
+read_cache_file(
+        const std::string& path,
+        const VkPhysicalDeviceProperties& properties)
+{
+    struct PipelineCacheFileHeader header;
+    std::vector<char> data;
+    std::streamoff data_start;
+    std::streamoff file_end;
+
+    header = {};
+    data.resize(0);
+
+    std::ifstream file(path, std::ios::binary);
+
+    if ( ! file.is_open()) {
+        Log::i("Pipeline cache file not found, starting cold");
+        return data;
+    }
+
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if ( ! file || ! header_matches(header, properties)) {
+        Log::w("Pipeline cache file is stale or for another device, ignoring");
+        return data;
+    }
+
+    // Size comes from the file, check that it is there before allocating.
+    data_start = file.tellg();
+    file.seekg(0, std::ios::end);
+    file_end = file.tellg();
+    file.seekg(data_start);
+    if ( ! file || data_start < 0 || file_end < data_start ||
+            header.data_size > static_cast<std::uint64_t>(file_end - data_start)) {
+        Log::w("Pipeline cache file is truncated or corrupt, ignoring");
+        return data;
+    }
+
+    data.resize(header.data_size);
+    file.read(data.data(), data.size());
+    if ( ! file || ! vulkan_header_matches(data, properties)) {
+        Log::w("Pipeline cache file is truncated or corrupt, ignoring");
+        data.resize(0);
+    }
+
+    return data;
+}
+
+PipelineCache::PipelineCache() :
+    m_cache(VK_NULL_HANDLE),
+    m_warm(false),
+    m_path(""),
+    m_properties({})
+{
+}
+
+void PipelineCache::load(
+        const VkPhysicalDevice& physical_device,
+        const VkDevice& logical_device)
+{
+    VkResult result;
+    VkPipelineCacheCreateInfo create_info;
+    std::vector<char> data;
+
+    result = VK_ERROR_UNKNOWN;
+    create_info = {};
+    data.resize(0);
+
+    vkGetPhysicalDeviceProperties(physical_device, &m_properties);
+
+    m_path = get_cache_path();
+    if ( ! m_path.empty()) {
+        data = read_cache_file(m_path, m_properties);
+    }
+
+    create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    create_info.initialDataSize = data.size();
+    create_info.pInitialData = data.empty() ? nullptr : data.data();
+
+    result = vkCreatePipelineCache(logical_device, &create_info, nullptr, &m_cache);
+    if (VK_SUCCESS != result && ! data.empty()) {
+        // Driver rejected the data after all, start over with empty cache.
+        Log::w("Driver rejected pipeline cache data, starting cold");
+        create_info.initialDataSize = 0;
+        create_info.pInitialData = nullptr;
+        data.resize(0);
+        result = vkCreatePipelineCache(logical_device, &create_info, nullptr, &m_cache);
+    }
+    if (VK_SUCCESS != result) {
+        throw std::runtime_error("Failed to create pipeline cache");
+    }
+
+    m_warm = ! data.empty();
+}
+
+void PipelineCache::save(const VkDevice& logical_device)
+{
+    VkResult result;
+    size_t data_size;
+    std::vector<char> data;
+    std::string path_temporary;
+    std::error_code error;
+    struct PipelineCacheFileHeader header;
+
+    result = VK_ERROR_UNKNOWN;
+    data_size = 0;
+    data.resize(0);
+    header = {};
+
+    if (m_path.empty() || VK_NULL_HANDLE == m_cache) {
+        return;
+    }
+
+    result = vkGetPipelineCacheData(logical_device, m_cache, &data_size, nullptr);
+    if (VK_SUCCESS != result || 0 == data_size) {
+        Log::w("Failed to query pipeline cache size, not saving");
+        return;
+    }
+
+    data.resize(data_size);
+    result = vkGetPipelineCacheData(logical_device, m_cache, &data_size, data.data());
+    if (VK_SUCCESS != result) {
+        Log::w("Failed to retrieve pipeline cache data, not saving");
+        return;
+    }
+    data.resize(data_size);
+
+    header.magic = PIPELINE_CACHE_MAGIC;
+    header.format_version = PIPELINE_CACHE_FORMAT_VERSION;
+    header.vendor_id = m_properties.vendorID;
+    header.device_id = m_properties.deviceID;
+    header.driver_version = m_properties.driverVersion;
+    std::memcpy(
+            header.pipeline_cache_uuid,
+            m_properties.pipelineCacheUUID,
+            VK_UUID_SIZE);
+    header.data_size = data.size();
+
+    std::filesystem::create_directories(
+            std::filesystem::path(m_path).parent_path(),
+            error);
+    if (error) {
+        LOG_W("Failed to create pipeline cache directory: {}", error.message());
+        return;
+    }
+
+    // Write aside and rename, so that a crash never leaves a partial file.
+    path_temporary = m_path + ".tmp";
+    {
+        std::ofstream file(path_temporary, std::ios::binary | std::ios::trunc);
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(data.data(), data.size());
+        if ( ! file) {
+            LOG_W("Failed to write pipeline cache file {}", path_temporary);
+            return;
+        }
+    }
+
+    std::filesystem::rename(path_temporary, m_path, error);
+    if (error) {
+        LOG_W("Failed to move pipeline cache file in place: {}", error.message());
+        return;
+    }
+
+    LOG_I("Saved pipeline cache of {} bytes", data.size());
+}
+
+void PipelineCache::destroy(const VkDevice& logical_device)
+{
+    if (VK_NULL_HANDLE != m_cache) {
+        vkDestroyPipelineCache(logical_device, m_cache, nullptr);
+        m_cache = VK_NULL_HANDLE;
+    }
+}
@@ -0,0 +1,185 @@
+#include "Randomizer.hpp"
+
+#include <algorithm>
+
+#define BAG_PERMUTATION_COUNT 5040 // 7!
+
+typedef std::array<std::uint8_t, RANDOMIZER_BAG_SIZE> Bag;
+
+// Rearranges bag into the lexicographically next order, false after the last.
+static constexpr bool
+next_bag_permutation(Bag& bag)
+{
+    std::int32_t i = RANDOMIZER_BAG_SIZE - 2;
+    std::int32_t j = RANDOMIZER_BAG_SIZE - 1;
+    std::uint8_t swap = 0;
+
+    while (i >= 0 && bag[i] >= bag[i + 1]) {
+        i--;
+    }
+    if (i < 0) {
+        return false;
+    }
+
+    while (bag[j] <= bag[i]) {
+        j--;
+    }
+
+    swap = bag[i];
+    bag[i] = bag[j];
+    bag[j] = swap;
+
+    for (j = RANDOMIZER_BAG_SIZE - 1, i++; i < j; i++, j--) {
+        swap = bag[i];
+        bag[i] = bag[j];
+        bag[j] = swap;
+    }
+
+    return true;
+}
+
+static constexpr std::array<Bag, BAG_PERMUTATION_COUNT>
+make_bag_permutations()
+{
+    std::array<Bag, BAG_PERMUTATION_COUNT> permutations = {};
+    Bag bag = {};
+
+    for (std::int32_t i = 0; i < RANDOMIZER_BAG_SIZE; i++) {
+        bag[i] = static_cast<std::uint8_t>(i);
+    }
+
+    for (std::int32_t i = 0; i < BAG_PERMUTATION_COUNT; i++) {
+        permutations[i] = bag;
+        next_bag_permutation(bag);
+    }
+
+    return permutations;
+}
+
+/*
+ * Every order of a bag, so that shuffling a bag takes a single draw instead
+ * of a draw per piece.
+ */
+static constexpr std::array<Bag, BAG_PERMUTATION_COUNT> g_bag_permutations =
+    make_bag_permutations();
+
+static_assert(6 == g_bag_permutations[0][6] && 0 == g_bag_permutations[5039][6],
+        "Bag permutations in lexicographic order");
+
+static std::uint64_t
+splitmix64(std::uint64_t& state)
+{
+    std::uint64_t z;
+
+    state += 0x9E3779B97F4A7C15ull;
+    z = state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+
+    return z ^ (z >> 31);
+}
+
+void Xoshiro256::seed(std::uint64_t seed)
+{
+    // splitmix64 never yields an all zero state from any seed.
+    for (std::uint64_t& word : m_state) {
+        word = splitmix64(seed);
+    }
+}
+
+std::uint32_t Xoshiro256::bounded(std::uint32_t bound)
+{
+    std::uint64_t product;
+    std::uint32_t low;
+    std::uint32_t threshold;
+
+    // Multiply and shift instead of modulo, rejecting the few values which
+    // would make the lowest results more likely (Lemire).
+    product = (next() >> 32) * bound;
+    low = static_cast<std::uint32_t>(product);
+    if (low < bound) {
+        threshold = -bound % bound;
+        while (low < threshold) {
+            product = (next() >> 32) * bound;
+            low = static_cast<std::uint32_t>(product);
+        }
+    }
+
+    return static_cast<std::uint32_t>(product >> 32);
+}
+
+Randomizer::Randomizer(std::int32_t mode, std::uint64_t seed) :
+    m_mode(mode)
+{
+    reset(seed);
+}
+
+void Randomizer::reset(std::uint64_t seed)
+{
+    m_random.seed(seed);
+    m_pieces.fill(0);
+    m_head = 0;
+    m_tail = 0;
+
+    fill();
+}
+
+void Randomizer::fill()
+{
+    std::uint32_t index;
+
+    while (RANDOMIZER_RING_SIZE - (m_tail - m_head) >= RANDOMIZER_BAG_SIZE) {
+        if (RANDOMIZER_BAG == m_mode) {
+            const Bag& bag = g_bag_permutations[m_random.bounded(BAG_PERMUTATION_COUNT)];
+
+            for (std::int32_t i = 0; i < RANDOMIZER_BAG_SIZE; i++) {
+                m_pieces[(m_tail + i) & (RANDOMIZER_RING_SIZE - 1)] = bag[i];
+            }
+        } else {
+            for (std::int32_t i = 0; i < RANDOMIZER_BAG_SIZE; i++) {
+                index = m_random.bounded(TETROMINO_COUNT);
+                m_pieces[(m_tail + i) & (RANDOMIZER_RING_SIZE - 1)] =
+                    static_cast<std::uint8_t>(index);
+            }
+        }
+
+        m_tail += RANDOMIZER_BAG_SIZE;
+    }
+}
+
+void Randomizer::take(std::uint8_t* pieces, std::size_t count)
+{
+    std::size_t chunk;
+
+    while (count > 0) {
+        chunk = std::min<std::size_t>(count, m_tail - m_head);
+
+        for (std::size_t i = 0; i < chunk; i++) {
+            pieces[i] = m_pieces[(m_head + i) & (RANDOMIZER_RING_SIZE - 1)];
+        }
+
+        m_head += chunk;
+        pieces += chunk;
+        count -= chunk;
+
+        if (m_tail - m_head < RANDOMIZER_BAG_SIZE) {
+            fill();
+        }
+    }
+}
+
+void Randomizer::discard(std::uint64_t count)
+{
+    std::uint64_t chunk;
+
+    while (count > 0) {
+        chunk = std::min<std::uint64_t>(count, m_tail - m_head);
+
+        m_head += chunk;
+        count -= chunk;
+
+        if (m_tail - m_head < RANDOMIZER_BAG_SIZE) {
+            fill();
+        }
+    }
+}
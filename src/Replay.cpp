@@ -0,0 +1,328 @@
+#include "Replay.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char g_replay_magic[4] = { 'N', 'T', 'R', 'P' };
+
+/*
+ * Snapshot fields index tables and the board, so a keyframe is checked
+ * before the game is restored from it. Piece must lie within the playfield,
+ * but may overlap the stack once the game is over. Each tick takes at most
+ * two pieces, one by holding and one by locking, and keyframe i is taken
+ * within a tick of i keyframe intervals into the game.
+ */
+static bool
+is_valid_keyframe(const ReplayHeader& header, const ReplayKeyframe& keyframe, std::uint64_t i)
+{
+    std::int32_t cell;
+
+    const GameSnapshot& state = keyframe.state;
+
+    if (keyframe.input_offset > header.input_size ||
+            keyframe.input_base_tick > state.ticks ||
+            state.ticks > header.tick_count ||
+            state.pieces > 2 * state.ticks + 1 ||
+            state.pieces > (i + 1) * std::max<std::uint64_t>(header.keyframe_interval, 1) + 2 ||
+            state.piece_type < 0 || state.piece_type >= TETROMINO_COUNT ||
+            state.piece_rotation < 0 || state.piece_rotation >= TETROMINO_ROTATION_COUNT ||
+            state.hold < -1 || state.hold >= TETROMINO_COUNT ||
+            state.shift_direction < -1 || state.shift_direction > 1) {
+        return false;
+    }
+
+    if (Board().collides(
+                tetromino_rows(state.piece_type, state.piece_rotation),
+                state.piece_x,
+                state.piece_y)) {
+        return false;
+    }
+
+    for (cell = 0; cell < BOARD_WIDTH * BOARD_HEIGHT; cell++) {
+        if (((state.cells[cell / 2] >> ((cell & 1) * 4)) & 0xF) > TETROMINO_COUNT) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static std::uint64_t
+align_up(std::uint64_t value, std::uint64_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+ReplayRecorder::ReplayRecorder() :
+    m_active(false),
+    m_header(),
+    m_last_tick(0),
+    m_next_keyframe_pieces(0)
+{
+}
+
+void ReplayRecorder::start(const Game& game, std::uint32_t keyframe_interval)
+{
+    m_header = {};
+    std::memcpy(m_header.magic, g_replay_magic, sizeof(g_replay_magic));
+    m_header.format_version = REPLAY_FORMAT_VERSION;
+    m_header.seed = game.seed();
+    m_header.settings = game.settings();
+    m_header.keyframe_interval = keyframe_interval;
+
+    m_inputs.clear();
+    m_keyframes.clear();
+    m_last_tick = game.ticks();
+    m_active = true;
+
+    add_keyframe(game);
+}
+
+void ReplayRecorder::put_varint(std::uint64_t value)
+{
+    while (value >= 0x80) {
+        m_inputs.push_back(static_cast<std::uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    m_inputs.push_back(static_cast<std::uint8_t>(value));
+}
+
+void ReplayRecorder::add_keyframe(const Game& game)
+{
+    struct ReplayKeyframe keyframe;
+
+    keyframe = {};
+    keyframe.input_offset = m_inputs.size();
+    keyframe.input_base_tick = m_last_tick;
+    game.save(keyframe.state);
+
+    m_keyframes.push_back(keyframe);
+    m_next_keyframe_pieces = game.pieces() + m_header.keyframe_interval;
+}
+
+void ReplayRecorder::record_key(
+        const Game& game,
+        std::int32_t key,
+        bool pressed,
+        std::int32_t age)
+{
+    if ( ! m_active) {
+        return;
+    }
+
+    put_varint(game.ticks() - m_last_tick);
+    m_inputs.push_back(static_cast<std::uint8_t>(key << 1 | pressed));
+    put_varint(static_cast<std::uint64_t>(age));
+
+    m_last_tick = game.ticks();
+}
+
+void ReplayRecorder::record_tick(const Game& game)
+{
+    if ( ! m_active) {
+        return;
+    }
+
+    m_header.tick_count = game.ticks();
+
+    if (game.pieces() >= m_next_keyframe_pieces) {
+        add_keyframe(game);
+    }
+}
+
+void ReplayRecorder::write(const std::string& path) const
+{
+    struct ReplayHeader header;
+    std::uint64_t padding;
+    const char zeros[8] = {};
+
+    header = m_header;
+    header.input_offset = sizeof(header);
+    header.input_size = m_inputs.size();
+    header.keyframe_offset = align_up(header.input_offset + header.input_size, 8);
+    header.keyframe_count = m_keyframes.size();
+    padding = header.keyframe_offset - header.input_offset - header.input_size;
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(m_inputs.data()), m_inputs.size());
+    file.write(zeros, padding);
+    file.write(
+            reinterpret_cast<const char*>(m_keyframes.data()),
+            m_keyframes.size() * sizeof(struct ReplayKeyframe));
+    if ( ! file) {
+        throw std::runtime_error("Failed to write replay " + path);
+    }
+}
+
+ReplayPlayer::ReplayPlayer() :
+    m_data(nullptr),
+    m_size(0),
+    m_header(nullptr),
+    m_inputs(nullptr),
+    m_keyframes(nullptr),
+    m_cursor(0),
+    m_next_tick(UINT64_MAX)
+{
+}
+
+ReplayPlayer::~ReplayPlayer()
+{
+    close();
+}
+
+void ReplayPlayer::open(const std::string& path)
+{
+    int fd;
+    void* data;
+    struct stat file_status;
+    const ReplayHeader* header;
+
+    close();
+
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (-1 == fd) {
+        throw std::runtime_error("Failed to open replay " + path);
+    }
+
+    if (0 != fstat(fd, &file_status) ||
+            file_status.st_size < static_cast<off_t>(sizeof(ReplayHeader))) {
+        ::close(fd);
+        throw std::runtime_error("Replay too short: " + path);
+    }
+
+    data = mmap(nullptr, file_status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (MAP_FAILED == data) {
+        throw std::runtime_error("Failed to map replay " + path);
+    }
+
+    m_data = static_cast<const std::uint8_t*>(data);
+    m_size = file_status.st_size;
+    header = reinterpret_cast<const ReplayHeader*>(m_data);
+
+    if (0 != std::memcmp(header->magic, g_replay_magic, sizeof(g_replay_magic)) ||
+            REPLAY_FORMAT_VERSION != header->format_version ||
+            header->input_offset > m_size ||
+            header->input_size > m_size - header->input_offset ||
+            header->settings.randomizer < 0 ||
+            header->settings.randomizer >= RANDOMIZER_MODE_COUNT ||
+            0 != header->keyframe_offset % 8 ||
+            header->keyframe_offset > m_size ||
+            0 == header->keyframe_count ||
+            header->keyframe_count >
+                (m_size - header->keyframe_offset) / sizeof(ReplayKeyframe)) {
+        close();
+        throw std::runtime_error("Invalid replay " + path);
+    }
+
+    m_header = header;
+    m_inputs = m_data + header->input_offset;
+    m_keyframes = reinterpret_cast<const ReplayKeyframe*>(m_data + header->keyframe_offset);
+}
+
+void ReplayPlayer::close()
+{
+    if (nullptr != m_data) {
+        munmap(const_cast<std::uint8_t*>(m_data), m_size);
+    }
+
+    m_data = nullptr;
+    m_size = 0;
+    m_header = nullptr;
+    m_inputs = nullptr;
+    m_keyframes = nullptr;
+}
+
+Game ReplayPlayer::create_game()
+{
+    Game game(m_header->settings, m_header->seed);
+
+    seek(game, 0);
+
+    return game;
+}
+
+void ReplayPlayer::seek(Game& game, std::uint64_t i)
+{
+    const ReplayKeyframe& keyframe = m_keyframes[i];
+
+    // Checked here rather than in open(), so that keyframes are only paged
+    // in when seeked to.
+    if ( ! is_valid_keyframe(*m_header, keyframe, i)) {
+        throw std::runtime_error("Invalid keyframe in replay");
+    }
+
+    game.restore(keyframe.state);
+
+    m_cursor = keyframe.input_offset;
+    m_next_tick = keyframe.input_base_tick;
+    read_next_tick();
+}
+
+std::uint64_t ReplayPlayer::get_varint()
+{
+    std::uint64_t value;
+    std::int32_t shift;
+    std::uint8_t byte;
+
+    value = 0;
+    shift = 0;
+
+    do {
+        if (m_cursor >= m_header->input_size || shift > 63) {
+            throw std::runtime_error("Truncated replay input stream");
+        }
+        byte = m_inputs[m_cursor++];
+        value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    return value;
+}
+
+void ReplayPlayer::read_next_tick()
+{
+    if (m_cursor >= m_header->input_size) {
+        m_next_tick = UINT64_MAX;
+        return;
+    }
+
+    m_next_tick += get_varint();
+}
+
+bool ReplayPlayer::apply(Game& game)
+{
+    std::uint8_t key_state;
+    std::uint64_t age;
+
+    if (game.ticks() >= m_header->tick_count) {
+        return false;
+    }
+
+    while (m_next_tick == game.ticks()) {
+        if (m_cursor >= m_header->input_size) {
+            throw std::runtime_error("Truncated replay input stream");
+        }
+        key_state = m_inputs[m_cursor++];
+        age = get_varint();
+
+        if ((key_state >> 1) >= GAME_KEY_COUNT || age >= GAME_SUBTICK_ONE) {
+            throw std::runtime_error("Invalid record in replay input stream");
+        }
+
+        game.set_key(key_state >> 1, key_state & 1, static_cast<std::int32_t>(age));
+
+        read_next_tick();
+    }
+
+    return true;
+}
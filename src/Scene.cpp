@@ -0,0 +1,123 @@
+#include "Scene.hpp"
+
+static std::uint32_t
+write_piece(
+        std::uint32_t* instances,
+        const PieceRows& piece,
+        std::int32_t x,
+        std::int32_t y,
+        std::uint32_t colour,
+        std::uint32_t flags,
+        std::int32_t row_limit)
+{
+    std::uint32_t count;
+    std::uint32_t bits;
+    std::int32_t column;
+
+    count = 0;
+
+    for (std::int32_t i = 0; i < BOARD_PIECE_ROWS; i++) {
+        if (y + i < 0 || y + i >= row_limit) {
+            continue;
+        }
+
+        bits = piece.rows[i];
+        while (bits) {
+            column = __builtin_ctz(bits);
+            bits &= bits - 1;
+            instances[count++] = scene_pack_block(
+                    x + column,
+                    y + i,
+                    colour,
+                    flags);
+        }
+    }
+
+    return count;
+}
+
+std::uint32_t
+scene_build_instances(const Game& game, std::uint32_t* instances)
+{
+    std::uint32_t count;
+    std::uint32_t bits;
+    std::int32_t column;
+    std::int32_t type;
+
+    const Board& board = game.board();
+    const ActivePiece& piece = game.piece();
+
+    count = 0;
+
+    // Walls around the visible part of the playfield
+    for (std::int32_t row = 0; row <= BOARD_VISIBLE_HEIGHT; row++) {
+        instances[count++] = scene_pack_block(
+                SCENE_BOARD_X - 1, SCENE_BOARD_Y - 1 + row, SCENE_COLOUR_WALL, 0);
+        instances[count++] = scene_pack_block(
+                SCENE_BOARD_X + BOARD_WIDTH, SCENE_BOARD_Y - 1 + row, SCENE_COLOUR_WALL, 0);
+    }
+    for (column = 0; column < BOARD_WIDTH; column++) {
+        instances[count++] = scene_pack_block(
+                SCENE_BOARD_X + column, SCENE_BOARD_Y - 1, SCENE_COLOUR_WALL, 0);
+    }
+
+    for (std::int32_t row = 0; row < SCENE_BOARD_ROWS; row++) {
+        bits = board.row_cells(row);
+        while (bits) {
+            column = __builtin_ctz(bits);
+            bits &= bits - 1;
+            instances[count++] = scene_pack_block(
+                    SCENE_BOARD_X + column,
+                    SCENE_BOARD_Y + row,
+                    game.cell_type(column, row),
+                    0);
+        }
+    }
+
+    if ( ! game.game_over()) {
+        const PieceRows& rows = tetromino_rows(piece.type, piece.rotation);
+
+        count += write_piece(
+                &instances[count],
+                rows,
+                SCENE_BOARD_X + piece.x,
+                SCENE_BOARD_Y + game.ghost_y(),
+                piece.type,
+                SCENE_FLAG_GHOST,
+                SCENE_BOARD_Y + SCENE_BOARD_ROWS);
+        count += write_piece(
+                &instances[count],
+                rows,
+                SCENE_BOARD_X + piece.x,
+                SCENE_BOARD_Y + piece.y,
+                piece.type,
+                0,
+                SCENE_BOARD_Y + SCENE_BOARD_ROWS);
+    }
+
+    type = game.hold();
+    if (type >= 0) {
+        count += write_piece(
+                &instances[count],
+                tetromino_rows(type, ROTATION_SPAWN),
+                SCENE_HOLD_X,
+                SCENE_HOLD_Y,
+                type,
+                0,
+                SCENE_HEIGHT);
+    }
+
+    for (std::int32_t i = 0; i < GAME_NEXT_QUEUE_LENGTH; i++) {
+        type = game.next(i);
+        count += write_piece(
+                &instances[count],
+                tetromino_rows(type, ROTATION_SPAWN),
+                SCENE_NEXT_X,
+                SCENE_NEXT_Y - i * SCENE_NEXT_SPACING,
+                type,
+                0,
+                SCENE_HEIGHT);
+    }
+
+    return count;
+}
@@ -0,0 +1,13 @@
+#include "Shaders.hpp"
+
+// Generated by glslc -mfmt=c, each file is a braced list of 32-bit words.
+static constexpr std::uint32_t g_words_vert[] =
+#include "vert.spv.inc"
+;
+
+static constexpr std::uint32_t g_words_frag[] =
+#include "frag.spv.inc"
+;
+
+const ShaderCode g_shader_code_vert = { g_words_vert, sizeof(g_words_vert) };
+const ShaderCode g_shader_code_frag = { g_words_frag, sizeof(g_words_frag) };
@@ -0,0 +1,71 @@
+#include "StartupProfiler.hpp"
+
+#include <cstdio>
+
+#include "Log.hpp"
+
+#define STARTUP_PROFILER_NAME_WIDTH 24
+
+static std::string
+format_row(const std::string& name, std::chrono::steady_clock::duration duration)
+{
+    char buffer[64];
+
+    std::snprintf(
+            buffer,
+            sizeof(buffer),
+            "%-*s %10.3f ms",
+            STARTUP_PROFILER_NAME_WIDTH,
+            name.c_str(),
+            std::chrono::duration<double, std::milli>(duration).count());
+
+    return buffer;
+}
+
+StartupProfiler::StartupProfiler() :
+    m_start(std::chrono::steady_clock::now()),
+    m_previous(m_start),
+    m_first_frame(m_start),
+    m_first_frame_done(false)
+{
+    m_phases.reserve(16);
+}
+
+void StartupProfiler::mark(const std::string& phase)
+{
+    std::chrono::steady_clock::time_point now;
+
+    now = std::chrono::steady_clock::now();
+    m_phases.push_back({phase, now - m_previous});
+    m_previous = now;
+}
+
+void StartupProfiler::mark_first_frame()
+{
+    if (m_first_frame_done) {
+        return;
+    }
+
+    mark("first frame");
+    m_first_frame = m_previous;
+    m_first_frame_done = true;
+}
+
+std::chrono::steady_clock::duration StartupProfiler::time_to_first_frame() const
+{
+    return m_first_frame - m_start;
+}
+
+void StartupProfiler::report() const
+{
+    Log::i("Startup breakdown:");
+    for (const Phase& phase : m_phases) {
+        Log::i(format_row(phase.name, phase.duration));
+    }
+
+    if (m_first_frame_done) {
+        Log::i(format_row("time to first frame", time_to_first_frame()));
+    } else {
+        Log::i("No frame was presented");
+    }
+}
@@ -0,0 +1,164 @@
+#include "TaskPool.hpp"
+
+#include <algorithm>
+
+TaskPool::TaskPool() :
+    m_thread_count(1),
+    m_function(nullptr),
+    m_context(nullptr),
+    m_remaining(0),
+    m_generation(0),
+    m_stopping(false)
+{
+    for (WorkerQueue& queue : m_queues) {
+        queue.head = 0;
+        queue.tail = 0;
+    }
+}
+
+TaskPool::~TaskPool()
+{
+    stop();
+}
+
+void TaskPool::start(std::int32_t thread_count)
+{
+    if (thread_count <= 0) {
+        thread_count = static_cast<std::int32_t>(std::thread::hardware_concurrency());
+    }
+
+    m_thread_count = std::min(std::max(thread_count, 1), TASK_POOL_MAX_THREADS);
+    m_stopping = false;
+
+    for (std::int32_t worker = 1; worker < m_thread_count; worker++) {
+        m_threads.emplace_back(&TaskPool::work, this, worker);
+    }
+}
+
+void TaskPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+
+    for (std::thread& thread : m_threads) {
+        thread.join();
+    }
+
+    m_threads.clear();
+    m_thread_count = 1;
+}
+
+void TaskPool::run(std::uint32_t count, TaskFunction function, void* context)
+{
+    std::uint32_t chunks;
+    std::uint32_t begin;
+    std::uint32_t end;
+
+    if (0 == count) {
+        return;
+    }
+
+    m_function = function;
+    m_context = context;
+
+    chunks = std::min<std::uint32_t>(count, m_thread_count * TASK_POOL_CHUNKS_PER_THREAD);
+    m_remaining.store(chunks, std::memory_order_relaxed);
+
+    for (std::uint32_t i = 0; i < chunks; i++) {
+        WorkerQueue& queue = m_queues[i % m_thread_count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        begin = static_cast<std::uint32_t>(static_cast<std::uint64_t>(count) * i / chunks);
+        end = static_cast<std::uint32_t>(static_cast<std::uint64_t>(count) * (i + 1) / chunks);
+        queue.ranges[queue.tail++] = { begin, end };
+    }
+
+    if (m_thread_count > 1) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_generation++;
+        }
+        m_wake.notify_all();
+    }
+
+    while (0 != m_remaining.load(std::memory_order_acquire)) {
+        if ( ! run_one(0)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool TaskPool::run_one(std::int32_t worker)
+{
+    TaskRange range;
+    bool found;
+
+    found = false;
+
+    {
+        WorkerQueue& queue = m_queues[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (queue.head != queue.tail) {
+            range = queue.ranges[--queue.tail];
+            found = true;
+        }
+        if (queue.head == queue.tail) {
+            queue.head = 0;
+            queue.tail = 0;
+        }
+    }
+
+    for (std::int32_t i = 1; i < m_thread_count && ! found; i++) {
+        WorkerQueue& queue = m_queues[(worker + i) % m_thread_count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (queue.head != queue.tail) {
+            range = queue.ranges[queue.head++];
+            found = true;
+        }
+        if (queue.head == queue.tail) {
+            queue.head = 0;
+            queue.tail = 0;
+        }
+    }
+
+    if ( ! found) {
+        return false;
+    }
+
+    for (std::uint32_t index = range.begin; index < range.end; index++) {
+        m_function(m_context, index, worker);
+    }
+
+    m_remaining.fetch_sub(1, std::memory_order_acq_rel);
+
+    return true;
+}
+
+void TaskPool::work(std::int32_t worker)
+{
+    std::uint64_t generation;
+
+    generation = 0;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stopping || m_generation != generation; });
+            if (m_stopping) {
+                return;
+            }
+            generation = m_generation;
+        }
+
+        while (0 != m_remaining.load(std::memory_order_acquire)) {
+            if ( ! run_one(worker)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+}
@@ -0,0 +1,32 @@
+#include "TranspositionTable.hpp"
+
+TranspositionTable::TranspositionTable() :
+    m_mask(0)
+{
+}
+
+void TranspositionTable::resize(std::int32_t bits)
+{
+    std::vector<Line> lines;
+
+    if (bits <= 0) {
+        m_lines.swap(lines);
+        m_mask = 0;
+        return;
+    }
+
+    // Atomics can not be moved, so the table is allocated anew.
+    std::vector<Line>(static_cast<std::size_t>(1) << bits).swap(m_lines);
+    m_mask = (static_cast<std::uint64_t>(1) << bits) - 1;
+    clear();
+}
+
+void TranspositionTable::clear()
+{
+    for (Line& line : m_lines) {
+        for (Entry& entry : line.entries) {
+            entry.check.store(0, std::memory_order_relaxed);
+            entry.value.store(0, std::memory_order_relaxed);
+        }
+    }
+}
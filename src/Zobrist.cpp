@@ -0,0 +1,19 @@
+#include "Zobrist.hpp"
+
+std::uint64_t zobrist_board(const Board& board)
+{
+    std::uint64_t hash;
+    std::uint32_t cells;
+
+    hash = 0;
+
+    for (std::int32_t y = 0; y < BOARD_HEIGHT; y++) {
+        cells = board.row_cells(y);
+        while (cells) {
+            hash ^= g_zobrist_keys.cells[y][__builtin_ctz(cells)];
+            cells &= cells - 1;
+        }
+    }
+
+    return hash;
+}
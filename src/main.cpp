@@ -1,11 +1,26 @@
 #include <algorithm>
 #include <chrono>
-#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
 #include <limits>
+#include <random>
 #include <thread>
 #include <vector>
 
+#include "Bot.hpp"
+#include "FrameStats.hpp"
+#include "Game.hpp"
+#include "GpuRing.hpp"
+#include "ImageWriter.hpp"
+#include "Input.hpp"
 #include "Log.hpp"
+#include "PipelineCache.hpp"
+#include "Replay.hpp"
+#include "Scene.hpp"
+#include "Shaders.hpp"
+#include "StartupProfiler.hpp"
 
 #ifdef __linux__
 #include <vulkan/vulkan.h>
@@ -19,6 +34,57 @@
 const char* g_program_name = "neotetris";
 std::string g_msg_temp = "";
 
+// Upper bound for simulation ticks run back to back, after e.g. the process
+// got suspended. Remaining time is dropped instead of fast forwarding.
+const std::int32_t g_max_catch_up_ticks = 5;
+
+const std::chrono::steady_clock::duration g_frame_poll_interval =
+    std::chrono::milliseconds(1);
+
+const std::uint32_t g_default_frames_in_flight = 2;
+
+// Pieces between replay keyframes.
+const std::uint32_t g_replay_keyframe_interval = 50;
+
+// Largest bot transposition table, 2^24 lines of 64 bytes is 1 GiB.
+const std::int32_t g_max_bot_table_bits = 24;
+
+// Instance data of one frame within the ring buffer.
+const VkDeviceSize g_instance_region_size =
+    SCENE_MAX_INSTANCES * sizeof(std::uint32_t);
+const VkDeviceSize g_instance_region_alignment = 256;
+const std::uint32_t g_max_frames_in_flight = 8;
+
+// Headless mode renders RGBA, so that frames can be written out as they are.
+const VkFormat g_offscreen_format = VK_FORMAT_R8G8B8A8_SRGB;
+const VkExtent2D g_offscreen_extent = { 640, 480 };
+const std::uint32_t g_offscreen_bytes_per_pixel = 4;
+
+// Value of an option taking one of a fixed set of names.
+struct OptionName {
+    const char* name;
+    std::int32_t value;
+};
+
+const struct OptionName g_present_mode_names[] = {
+    { "fifo", VK_PRESENT_MODE_FIFO_KHR },
+    { "fifo-relaxed", VK_PRESENT_MODE_FIFO_RELAXED_KHR },
+    { "mailbox", VK_PRESENT_MODE_MAILBOX_KHR },
+    { "immediate", VK_PRESENT_MODE_IMMEDIATE_KHR },
+};
+
+const struct OptionName g_log_level_names[] = {
+    { "debug", LOG_LEVEL_DEBUG },
+    { "info", LOG_LEVEL_INFO },
+    { "warn", LOG_LEVEL_WARN },
+    { "error", LOG_LEVEL_ERROR },
+};
+
+const struct OptionName g_randomizer_names[] = {
+    { "bag", RANDOMIZER_BAG },
+    { "classic", RANDOMIZER_CLASSIC },
+};
+
 struct QueueFamilyIndices {
     std::uint32_t drawing_family;
     std::uint32_t presentation_family;
@@ -33,6 +99,110 @@ struct SurfaceProperties {
     std::vector<VkPresentModeKHR> present_modes;
 };
 
+/*
+ * Everything needed to have one frame in flight. Frames are used as a ring,
+ * so that the CPU can record frame N + 1 while the GPU executes frame N.
+ */
+struct FrameResources {
+    std::uint32_t slot;
+    VkCommandBuffer command_buffer;
+    VkSemaphore semaphore_image_available;
+    VkSemaphore semaphore_render_finished;
+    VkFence fence_in_flight;
+    // Timestamps of the last submission from this slot are yet to be read.
+    bool timestamps_pending;
+    // Submissions made from this slot and how many of them are known done.
+    std::uint64_t submissions;
+    std::uint64_t submissions_finished;
+};
+
+/*
+ * Timestamp queries around the render pass, two per frame slot. Query pool is
+ * VK_NULL_HANDLE when the drawing queue does not write timestamps.
+ */
+struct GpuTimestamps {
+    VkQueryPool query_pool;
+    double period_ns;
+    std::uint64_t valid_mask;
+};
+
+/*
+ * Command buffers recorded ahead of time, one per swapchain framebuffer.
+ * A command buffer is recorded again only when the version of the state it
+ * was recorded from differs from the current one. Empty when disabled.
+ */
+struct PrerecordedCommands {
+    std::vector<VkCommandBuffer> command_buffers;
+    std::vector<std::uint64_t> recorded_versions;
+    std::vector<GpuRing::Allocation> instance_regions;
+};
+
+/*
+ * Swapchain replaced by a recreated one, along with the objects created per
+ * image of it. Destroyed once every frame which was in flight when it got
+ * replaced has finished.
+ */
+struct RetiredSwapchain {
+    VkSwapchainKHR swapchain;
+    std::vector<VkImageView> image_views;
+    std::vector<VkFramebuffer> framebuffers;
+    // Submission count of each frame slot at the time of replacing.
+    std::vector<std::uint64_t> frame_submissions;
+};
+
+// Push constant mapping scene grid to normalized device coordinates.
+struct SceneTransform {
+    float scale[2];
+    float offset[2];
+};
+
+struct Options {
+    std::uint32_t frames_in_flight;
+    bool prerecord;
+    // Preferred one, falls back to other modes when not available.
+    VkPresentModeKHR present_mode;
+    // Zero when frame rate is not limited.
+    std::uint32_t fps_limit;
+    // Zero when there is no budget.
+    std::uint32_t startup_budget_ms;
+    // Log is written to stdout as text when empty.
+    std::string binary_log_path;
+    std::int32_t log_level;
+    std::uint32_t seed;
+    // RandomizerMode
+    std::int32_t randomizer;
+    // Frame timing summary is written as CSV at exit when not empty.
+    std::string frame_stats_path;
+    // Headless mode is used when not empty.
+    std::string headless_directory;
+    std::uint32_t headless_frames;
+    std::uint32_t headless_ticks;
+    bool headless_raw;
+    // Replay is written at exit when not empty.
+    std::string record_path;
+    // Replay is played back instead of taking input when not empty.
+    std::string replay_path;
+    std::uint32_t replay_keyframe;
+    // Bot plays instead of taking input when set.
+    bool bot;
+    BotSettings bot_settings;
+};
+
+/*
+ * Render target of headless mode. Rendered frames are copied into a host
+ * visible buffer, as optimally tiled images cannot be read directly.
+ */
+struct OffscreenTarget {
+    VkImage image;
+    VkDeviceMemory image_memory;
+    std::vector<VkImageView> image_views;
+    std::vector<VkFramebuffer> framebuffers;
+
+    VkBuffer readback_buffer;
+    VkDeviceMemory readback_memory;
+    void* readback_data;
+};
+
 static struct QueueFamilyIndices
 find_queue_family_indices(
         const VkPhysicalDevice& device,
@@ -67,11 +237,14 @@ find_queue_family_indices(
             queue_families.data());
 
     for (i = 0; i < queue_families.size(); i++) {
-        vkGetPhysicalDeviceSurfaceSupportKHR(
-                device,
-                i,
-                surface,
-                &has_presentation_support);
+        has_presentation_support = VK_FALSE;
+        if (VK_NULL_HANDLE != surface) {
+            vkGetPhysicalDeviceSurfaceSupportKHR(
+                    device,
+                    i,
+                    surface,
+                    &has_presentation_support);
+        }
 
         set_index =
             ( ! family_indices.presentation_family_found) &&
@@ -91,19 +264,32 @@ find_queue_family_indices(
         }
     }
 
+    // Without a surface nothing is presented, drawing queue stands in.
+    if (VK_NULL_HANDLE == surface) {
+        family_indices.presentation_family = family_indices.drawing_family;
+        family_indices.presentation_family_found =
+            family_indices.drawing_family_found;
+    }
+
     return family_indices;
 }
 
 static std::vector<const char*>
-get_required_device_extensions()
+get_required_device_extensions(bool presentation)
 {
+    if ( ! presentation) {
+        return {};
+    }
+
     return {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME,
     };
 }
 
 static bool
-device_extensions_are_supported(const VkPhysicalDevice& device)
+device_extensions_are_supported(
+        const VkPhysicalDevice& device,
+        bool presentation)
 {
     std::uint32_t i;
     std::uint32_t extension_count;
@@ -119,7 +305,7 @@ device_extensions_are_supported(const VkPhysicalDevice& device)
     extension_count = 0;
     available_extensions.resize(0);
     required_extensions = {};
-    required_extensions_char = get_required_device_extensions();
+    required_extensions_char = get_required_device_extensions(presentation);
 
     for (const char* extension : required_extensions_char) {
         required_extensions.push_back(extension);
@@ -224,10 +410,16 @@ device_is_suitable(
             &features);
 
     family_indices = find_queue_family_indices(device, surface);
-    extensions_supported = device_extensions_are_supported(device);
-    surface_properties = find_surface_properties(device, surface);
+    extensions_supported = device_extensions_are_supported(
+            device,
+            VK_NULL_HANDLE != surface);
+    if (VK_NULL_HANDLE != surface) {
+        surface_properties = find_surface_properties(device, surface);
+    }
 
-    if ( ! features.geometryShader ) {
+    // Geometry shaders are not actually used. Software implementations
+    // without them are still fine for rendering offscreen.
+    if ( ! features.geometryShader && VK_NULL_HANDLE != surface) {
         Log::w("Geometry shader not found");
         return false;
     }
@@ -262,8 +454,9 @@ device_is_suitable(
 
     // Via surface properties, check if swap chain support is present.
     is_suitable =
-        ( ! surface_properties.formats.empty()) &&
-        ( ! surface_properties.present_modes.empty());
+        VK_NULL_HANDLE == surface || (
+            ( ! surface_properties.formats.empty()) &&
+            ( ! surface_properties.present_modes.empty()));
     if ( ! is_suitable) {
         Log::w("Insufficient swap chain support");
         return false;
@@ -272,6 +465,42 @@ device_is_suitable(
     return true;
 }
 
+static VkInstance
+create_instance(const std::vector<const char*>& extension_names)
+{
+    VkResult result;
+    VkInstance vulkan_instance;
+    VkApplicationInfo application_info;
+    VkInstanceCreateInfo create_info;
+
+    result = VK_ERROR_UNKNOWN;
+    vulkan_instance = VK_NULL_HANDLE;
+    application_info = {};
+    create_info = {};
+
+    application_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    application_info.pApplicationName = g_program_name;
+    application_info.applicationVersion = VK_MAKE_VERSION(0, 0, 1);
+    application_info.pEngineName = "No engine";
+    application_info.engineVersion = VK_MAKE_VERSION(0, 0, 1);
+    application_info.apiVersion = VK_API_VERSION_1_0;
+
+    create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    create_info.pApplicationInfo = &application_info;
+    create_info.enabledExtensionCount = static_cast<uint32_t>(
+            extension_names.size());
+    create_info.ppEnabledExtensionNames = extension_names.data();
+    create_info.enabledLayerCount = 0; // Default to no validation layers
+
+    result = vkCreateInstance(&create_info, nullptr, &vulkan_instance);
+    if (VK_SUCCESS != result) {
+        g_msg_temp = "Failed to create Vulkan instance";
+        throw std::runtime_error(g_msg_temp);
+    }
+
+    return vulkan_instance;
+}
+
 static VkSurfaceKHR
 create_surface(SDL_Window* window, VkInstance* instance)
 {
@@ -356,7 +585,8 @@ pick_physical_device(VkInstance* vulkan_instance, const VkSurfaceKHR& surface)
 static VkDevice
 create_logical_device(
         const VkPhysicalDevice& device,
-        const struct QueueFamilyIndices& family_indices)
+        const struct QueueFamilyIndices& family_indices,
+        bool presentation)
 {
     float queue_priority;
 
@@ -375,7 +605,7 @@ create_logical_device(
     queue_create_info = {};
     device_features = {};
     device_create_info = {};
-    required_extensions = get_required_device_extensions();
+    required_extensions = get_required_device_extensions(presentation);
 
     queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
     queue_create_info.queueFamilyIndex = family_indices.drawing_family;
@@ -383,12 +613,15 @@ create_logical_device(
     queue_create_info.pQueuePriorities = &queue_priority;
     queue_create_info_vector.push_back(queue_create_info);
 
-    queue_create_info = {};
-    queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queue_create_info.queueFamilyIndex = family_indices.presentation_family;
-    queue_create_info.queueCount = 1;
-    queue_create_info.pQueuePriorities = &queue_priority;
-    queue_create_info_vector.push_back(queue_create_info);
+    // Each family may be listed only once.
+    if (family_indices.presentation_family != family_indices.drawing_family) {
+        queue_create_info = {};
+        queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queue_create_info.queueFamilyIndex = family_indices.presentation_family;
+        queue_create_info.queueCount = 1;
+        queue_create_info.pQueuePriorities = &queue_priority;
+        queue_create_info_vector.push_back(queue_create_info);
+    }
 
     device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     device_create_info.pQueueCreateInfos = queue_create_info_vector.data();
@@ -430,15 +663,70 @@ pick_swap_surface_format(
     throw std::runtime_error("pick_swap_surface_format: Could not find the preferred format combination");
 }
 
+static const char*
+get_present_mode_name(VkPresentModeKHR mode)
+{
+    for (const struct OptionName& entry : g_present_mode_names) {
+        if (entry.value == mode) {
+            return entry.name;
+        }
+    }
+
+    return "unknown";
+}
+
+/*
+ * Modes to try in order when preferring a mode. Low latency modes fall back
+ * on each other before settling for FIFO, which is the only mode guaranteed
+ * to be available.
+ */
+static std::vector<VkPresentModeKHR>
+get_present_mode_fallbacks(VkPresentModeKHR preferred)
+{
+    switch (preferred) {
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+        return {
+            VK_PRESENT_MODE_MAILBOX_KHR,
+            VK_PRESENT_MODE_IMMEDIATE_KHR,
+            VK_PRESENT_MODE_FIFO_KHR,
+        };
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+        return {
+            VK_PRESENT_MODE_IMMEDIATE_KHR,
+            VK_PRESENT_MODE_MAILBOX_KHR,
+            VK_PRESENT_MODE_FIFO_KHR,
+        };
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+        return {
+            VK_PRESENT_MODE_FIFO_RELAXED_KHR,
+            VK_PRESENT_MODE_FIFO_KHR,
+        };
+    default:
+        return {
+            VK_PRESENT_MODE_FIFO_KHR,
+        };
+    }
+}
+
 static VkPresentModeKHR
-pick_swap_present_mode(std::vector<VkPresentModeKHR> present_modes)
+pick_swap_present_mode(
+        const std::vector<VkPresentModeKHR>& present_modes,
+        VkPresentModeKHR preferred)
 {
-    for (const VkPresentModeKHR& mode : present_modes) {
-        if (VK_PRESENT_MODE_FIFO_KHR == mode) {
-            // VK_PRESENT_MODE_FIFO_KHR is told to be quaranteed to be
-            // available.
-            return VK_PRESENT_MODE_FIFO_KHR;
+    for (VkPresentModeKHR mode : get_present_mode_fallbacks(preferred)) {
+        if (present_modes.end() ==
+                std::find(present_modes.begin(), present_modes.end(), mode)) {
+            continue;
+        }
+
+        if (mode != preferred) {
+            LOG_W("Present mode {} not available, using {}",
+                    get_present_mode_name(preferred),
+                    get_present_mode_name(mode));
         }
+        LOG_I("Present mode: {}", get_present_mode_name(mode));
+
+        return mode;
     }
 
     throw std::runtime_error("VK_PRESENT_MODE_FIFO_KHR not available");
@@ -490,6 +778,8 @@ create_swap_chain(
         const VkDevice& logical_device,
         const VkSurfaceKHR& surface,
         SDL_Window* window,
+        VkPresentModeKHR preferred_present_mode,
+        const VkSwapchainKHR& old_swapchain,
         VkFormat& swapchain_image_format,
         VkExtent2D& swapchain_extent)
 {
@@ -536,7 +826,9 @@ create_swap_chain(
 
     surface_properties = find_surface_properties(device, surface);
     format = pick_swap_surface_format(surface_properties.formats);
-    present_mode = pick_swap_present_mode(surface_properties.present_modes);
+    present_mode = pick_swap_present_mode(
+            surface_properties.present_modes,
+            preferred_present_mode);
     extent = pick_swap_extent(surface_properties.capabilities, window);
     family_indices = find_queue_family_indices(device, surface);
 
@@ -593,7 +885,8 @@ create_swap_chain(
     chain_create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     chain_create_info.presentMode = present_mode;
     chain_create_info.clipped = VK_TRUE;
-    chain_create_info.oldSwapchain = VK_NULL_HANDLE;
+    // Lets the driver hand over resources of the swapchain being replaced.
+    chain_create_info.oldSwapchain = old_swapchain;
 
     result = vkCreateSwapchainKHR(
             logical_device,
@@ -657,41 +950,10 @@ create_image_views(
     return image_views;
 }
 
-static std::vector<char>
-read_file(const std::string& filename)
-{
-    size_t file_size;
-
-    std::vector<char> buffer;
-
-    file_size = 0;
-    buffer.resize(0);
-
-    std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-    if ( ! file.is_open()) {
-        throw std::runtime_error("Failed to open file");
-    }
-
-    file_size = (size_t) file.tellg();
-    buffer.resize(file_size);
-
-    g_msg_temp = "Reading file with size of: ";
-    g_msg_temp += std::to_string(file_size);
-    Log::d(g_msg_temp);
-
-    file.seekg(0);
-    file.read(buffer.data(), file_size);
-
-    file.close();
-
-    return buffer;
-}
-
 static VkShaderModule
 create_shader_module(
         const VkDevice& logical_device,
-        const std::vector<char>& code)
+        const ShaderCode& code)
 {
     VkResult result;
 
@@ -703,8 +965,8 @@ create_shader_module(
     result = VK_ERROR_UNKNOWN;
 
     create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    create_info.codeSize = code.size();
-    create_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
+    create_info.codeSize = code.size;
+    create_info.pCode = code.words;
 
     result = vkCreateShaderModule(logical_device, &create_info, nullptr, &shader_module);
     if (VK_SUCCESS != result) {
@@ -714,22 +976,28 @@ create_shader_module(
     return shader_module;
 }
 
+/*
+ * final_layout is VK_IMAGE_LAYOUT_PRESENT_SRC_KHR for swapchain images, or
+ * VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL for images copied out afterwards.
+ */
 static VkRenderPass
 create_render_pass(
         const VkDevice& logical_device,
-        const VkFormat swapchain_image_format)
+        const VkFormat swapchain_image_format,
+        const VkImageLayout final_layout)
 {
     VkResult result;
     VkRenderPass render_pass;
     VkSubpassDescription subpass;
-    VkSubpassDependency dependency;
+    VkSubpassDependency dependencies[2];
     VkRenderPassCreateInfo render_pass_info;
     VkAttachmentDescription color_attachment;
     VkAttachmentReference color_attachment_ref;
 
     result = VK_ERROR_UNKNOWN;
     subpass = {};
-    dependency = {};
+    dependencies[0] = {};
+    dependencies[1] = {};
     render_pass = {};
     render_pass_info = {};
     color_attachment = {};
@@ -742,7 +1010,7 @@ create_render_pass(
     color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    color_attachment.finalLayout = final_layout;
 
     color_attachment_ref.attachment = 0;
     color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
@@ -751,20 +1019,29 @@ create_render_pass(
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &color_attachment_ref;
 
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[0].srcAccessMask = 0;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    // Rendering has to be done before the image gets copied.
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
 
     render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
     render_pass_info.attachmentCount = 1;
     render_pass_info.pAttachments = &color_attachment;
     render_pass_info.subpassCount = 1;
     render_pass_info.pSubpasses = &subpass;
-    render_pass_info.dependencyCount = 1;
-    render_pass_info.pDependencies = &dependency;
+    render_pass_info.dependencyCount =
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL == final_layout ? 2 : 1;
+    render_pass_info.pDependencies = dependencies;
 
     result = vkCreateRenderPass(
             logical_device,
@@ -785,17 +1062,23 @@ create_pipeline_layout(const VkDevice& logical_device)
 
     VkPipelineLayout pipeline_layout;
     VkPipelineLayoutCreateInfo pipeline_layout_info;
+    VkPushConstantRange push_constant_range;
 
     result = VK_ERROR_UNKNOWN;
 
     pipeline_layout = {};
     pipeline_layout_info = {};
+    push_constant_range = {};
+
+    push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(struct SceneTransform);
 
     pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipeline_layout_info.setLayoutCount = 0;
     pipeline_layout_info.pSetLayouts = nullptr;
-    pipeline_layout_info.pushConstantRangeCount = 0;
-    pipeline_layout_info.pPushConstantRanges = nullptr;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
 
     result = vkCreatePipelineLayout(
             logical_device,
@@ -803,7 +1086,7 @@ create_pipeline_layout(const VkDevice& logical_device)
             nullptr,
             &pipeline_layout);
     if (VK_SUCCESS != result) {
-        std::runtime_error("Failed to create pipeline layout");
+        throw std::runtime_error("Failed to create pipeline layout");
     }
 
     return pipeline_layout;
@@ -840,16 +1123,39 @@ get_scissor(const VkExtent2D& swapchain_extent)
     return scissor;
 }
 
+/*
+ * Fits the scene grid into the swapchain extent with square cells, centered.
+ * Scene y grows upwards, Vulkan clip space y grows downwards.
+ */
+static struct SceneTransform
+get_scene_transform(const VkExtent2D& swapchain_extent)
+{
+    float cell_pixels;
+    struct SceneTransform transform;
+
+    transform = {};
+
+    cell_pixels = std::min(
+            (float) swapchain_extent.width / SCENE_WIDTH,
+            (float) swapchain_extent.height / SCENE_HEIGHT);
+
+    transform.scale[0] = 2.0f * cell_pixels / swapchain_extent.width;
+    transform.scale[1] = -2.0f * cell_pixels / swapchain_extent.height;
+    transform.offset[0] = -transform.scale[0] * SCENE_WIDTH / 2.0f;
+    transform.offset[1] = -transform.scale[1] * SCENE_HEIGHT / 2.0f;
+
+    return transform;
+}
+
 static VkPipeline
 create_graphics_pipeline(
         const VkDevice& logical_device,
         const VkExtent2D& swapchain_extent,
         const VkPipelineLayout& pipeline_layout,
-        const VkRenderPass& render_pass)
+        const VkRenderPass& render_pass,
+        const VkPipelineCache& pipeline_cache)
 {
     std::string entrypoint = "main";
-    std::vector<char> shader_code_vert;
-    std::vector<char> shader_code_frag;
     VkShaderModule shader_module_vert;
     VkShaderModule shader_module_frag;
 
@@ -859,6 +1165,8 @@ create_graphics_pipeline(
     VkPipelineShaderStageCreateInfo shader_stage_info_frag;
     VkPipelineShaderStageCreateInfo shader_stages[2];
 
+    VkVertexInputBindingDescription instance_binding;
+    VkVertexInputAttributeDescription instance_attribute;
     VkPipelineVertexInputStateCreateInfo vertex_input_info;
     VkPipelineInputAssemblyStateCreateInfo input_assembly;
     VkPipelineRasterizationStateCreateInfo rasterizer;
@@ -882,6 +1190,8 @@ create_graphics_pipeline(
     shader_stage_info_frag = {};
     color_blend_attachment = {};
     graphics_pipeline = {};
+    instance_binding = {};
+    instance_attribute = {};
     vertex_input_info = {};
     input_assembly = {};
     viewport_state = {};
@@ -895,15 +1205,12 @@ create_graphics_pipeline(
 
     result = VK_ERROR_UNKNOWN;
 
-    shader_code_vert = read_file("shaders/vert.spv");
-    shader_code_frag = read_file("shaders/frag.spv");
-
     shader_module_vert = create_shader_module(
             logical_device,
-            shader_code_vert);
+            g_shader_code_vert);
     shader_module_frag = create_shader_module(
             logical_device,
-            shader_code_frag);
+            g_shader_code_frag);
 
     shader_stage_info_vert.sType =
         VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -920,16 +1227,26 @@ create_graphics_pipeline(
     shader_stages[0] = shader_stage_info_vert;
     shader_stages[1] = shader_stage_info_frag;
 
+    // Quad corners come from gl_VertexIndex, only blocks are fed per instance.
+    instance_binding.binding = 0;
+    instance_binding.stride = sizeof(std::uint32_t);
+    instance_binding.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+    instance_attribute.location = 0;
+    instance_attribute.binding = 0;
+    instance_attribute.format = VK_FORMAT_R32_UINT;
+    instance_attribute.offset = 0;
+
     vertex_input_info.sType =
         VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertex_input_info.vertexBindingDescriptionCount = 0;
-    vertex_input_info.pVertexBindingDescriptions = nullptr;
-    vertex_input_info.vertexAttributeDescriptionCount = 0;
-    vertex_input_info.pVertexAttributeDescriptions = nullptr;
+    vertex_input_info.vertexBindingDescriptionCount = 1;
+    vertex_input_info.pVertexBindingDescriptions = &instance_binding;
+    vertex_input_info.vertexAttributeDescriptionCount = 1;
+    vertex_input_info.pVertexAttributeDescriptions = &instance_attribute;
 
     input_assembly.sType =
         VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
     input_assembly.primitiveRestartEnable = VK_FALSE;
 
     viewport = get_viewport(swapchain_extent);
@@ -951,7 +1268,8 @@ create_graphics_pipeline(
     rasterizer.rasterizerDiscardEnable = VK_FALSE;
     rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
     rasterizer.lineWidth = 1.0f;
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+    // Flat blocks only, winding flips along with the scene y axis.
+    rasterizer.cullMode = VK_CULL_MODE_NONE;
     rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
     rasterizer.depthBiasEnable = VK_FALSE;
     rasterizer.depthBiasConstantFactor = 0.0f;
@@ -993,7 +1311,7 @@ create_graphics_pipeline(
 
     result = vkCreateGraphicsPipelines(
             logical_device,
-            VK_NULL_HANDLE,
+            pipeline_cache,
             1,
             &pipeline_info,
             nullptr,
@@ -1109,41 +1427,34 @@ create_command_buffer(
     return command_buffer;
 }
 
+// Render pass drawing the scene, recorded into an already begun command buffer.
 static void
-record_command_buffer(
+record_scene_pass(
         VkCommandBuffer command_buffer,
-        uint32_t image_index,
         VkRenderPass& render_pass,
-        std::vector<VkFramebuffer>& swapchain_framebuffers,
+        VkFramebuffer framebuffer,
         VkExtent2D& swapchain_extent,
-        VkPipeline& graphics_pipeline)
+        VkPipelineLayout& pipeline_layout,
+        VkPipeline& graphics_pipeline,
+        VkBuffer instance_buffer,
+        VkDeviceSize instance_offset,
+        std::uint32_t instance_count)
 {
-    VkResult result;
-    VkCommandBufferBeginInfo begin_info;
     VkRenderPassBeginInfo render_pass_info;
     VkClearValue clear_color;
     VkViewport viewport;
     VkRect2D scissor;
+    struct SceneTransform transform;
 
-    result = VK_ERROR_UNKNOWN;
     scissor = {};
     viewport = {};
-    begin_info = {};
     render_pass_info = {};
     clear_color = {0.0f, 0.0f, 0.0f, 1.0f};
-
-    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    begin_info.flags = 0;
-    begin_info.pInheritanceInfo = nullptr;
-
-    result = vkBeginCommandBuffer(command_buffer, &begin_info);
-    if (VK_SUCCESS != result) {
-        throw std::runtime_error("Failed to begin recording a command buffer");
-    }
+    transform = get_scene_transform(swapchain_extent);
 
     render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     render_pass_info.renderPass = render_pass;
-    render_pass_info.framebuffer = swapchain_framebuffers[image_index];
+    render_pass_info.framebuffer = framebuffer;
     render_pass_info.renderArea.offset = {0, 0};
     render_pass_info.renderArea.extent = swapchain_extent;
     render_pass_info.clearValueCount = 1;
@@ -1166,441 +1477,2025 @@ record_command_buffer(
 
     vkCmdSetScissor(command_buffer, 0, 1, &scissor);
 
-    vkCmdDraw(command_buffer, 3, 1, 0, 0);
+    vkCmdPushConstants(
+            command_buffer,
+            pipeline_layout,
+            VK_SHADER_STAGE_VERTEX_BIT,
+            0,
+            sizeof(transform),
+            &transform);
 
-    vkCmdEndRenderPass(command_buffer);
+    vkCmdBindVertexBuffers(
+            command_buffer,
+            0,
+            1,
+            &instance_buffer,
+            &instance_offset);
 
-    result = vkEndCommandBuffer(command_buffer);
-    if (VK_SUCCESS != result) {
-        throw std::runtime_error("Failed to end command buffer");
-    }
+    // Every block on screen in one draw, a unit quad per instance.
+    vkCmdDraw(command_buffer, 4, instance_count, 0, 0);
+
+    vkCmdEndRenderPass(command_buffer);
 }
 
 static void
-draw_frame(
-        VkDevice& logical_device,
-        VkFence& fence_in_flight,
-        VkSwapchainKHR& swapchain,
-        VkSemaphore& semaphore_image_available,
-        VkSemaphore& semaphore_render_finished,
-        VkCommandBuffer& command_buffer,
+record_command_buffer(
+        VkCommandBuffer command_buffer,
+        uint32_t image_index,
         VkRenderPass& render_pass,
         std::vector<VkFramebuffer>& swapchain_framebuffers,
         VkExtent2D& swapchain_extent,
+        VkPipelineLayout& pipeline_layout,
         VkPipeline& graphics_pipeline,
-        VkQueue& drawing_queue,
-        VkQueue& presentation_queue)
+        VkBuffer instance_buffer,
+        VkDeviceSize instance_offset,
+        std::uint32_t instance_count,
+        VkQueryPool query_pool,
+        std::uint32_t first_query)
 {
     VkResult result;
-    VkSubmitInfo submit_info;
-    VkPresentInfoKHR present_info;
-    VkSemaphore wait_semaphores[1];
-    VkSemaphore signal_semaphores[1];
-    VkPipelineStageFlags wait_stages[1];
-    VkSwapchainKHR swapchains[1];
-
-    uint32_t image_index;
-    uint32_t flags;
+    VkCommandBufferBeginInfo begin_info;
 
     result = VK_ERROR_UNKNOWN;
-    submit_info = {};
-    present_info = {};
-    swapchains[0] = swapchain;
-    wait_semaphores[0] = semaphore_image_available;
-    signal_semaphores[0] = semaphore_render_finished;
-    wait_stages[0] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-
-    flags = 0;
-    image_index = -1;
-
-    vkWaitForFences(logical_device, 1, &fence_in_flight, VK_TRUE, UINT64_MAX);
+    begin_info = {};
 
-    vkResetFences(logical_device, 1, &fence_in_flight);
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = 0;
+    begin_info.pInheritanceInfo = nullptr;
 
-    result = vkAcquireNextImageKHR(
-            logical_device,
-            swapchain,
-            UINT64_MAX,
-            semaphore_image_available,
-            VK_NULL_HANDLE,
-            &image_index);
+    result = vkBeginCommandBuffer(command_buffer, &begin_info);
     if (VK_SUCCESS != result) {
-        throw std::runtime_error(
-            "Failed to retrieve index of next available presentable image");
+        throw std::runtime_error("Failed to begin recording a command buffer");
     }
 
-    vkResetCommandBuffer(command_buffer, flags);
+    if (VK_NULL_HANDLE != query_pool) {
+        vkCmdResetQueryPool(command_buffer, query_pool, first_query, 2);
+        vkCmdWriteTimestamp(
+                command_buffer,
+                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                query_pool,
+                first_query);
+    }
 
-    record_command_buffer(
+    record_scene_pass(
             command_buffer,
-            image_index,
             render_pass,
-            swapchain_framebuffers,
+            swapchain_framebuffers[image_index],
             swapchain_extent,
-            graphics_pipeline);
-
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.waitSemaphoreCount = 1;
-    submit_info.pWaitSemaphores = wait_semaphores;
-    submit_info.pWaitDstStageMask = wait_stages;
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &command_buffer;
-    submit_info.signalSemaphoreCount = 1;
-    submit_info.pSignalSemaphores = signal_semaphores;
-
-    present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-    present_info.waitSemaphoreCount = 1;
-    present_info.pWaitSemaphores = signal_semaphores;
-    present_info.swapchainCount = 1;
-    present_info.pSwapchains = swapchains;
-    present_info.pImageIndices = &image_index;
-
-    result = vkQueueSubmit(drawing_queue, 1, &submit_info, fence_in_flight);
-    if (VK_SUCCESS != result) {
-        throw std::runtime_error("Failed to submit draw command buffer");
+            pipeline_layout,
+            graphics_pipeline,
+            instance_buffer,
+            instance_offset,
+            instance_count);
+
+    if (VK_NULL_HANDLE != query_pool) {
+        vkCmdWriteTimestamp(
+                command_buffer,
+                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                query_pool,
+                first_query + 1);
     }
 
-    result = vkQueuePresentKHR(presentation_queue, &present_info);
+    result = vkEndCommandBuffer(command_buffer);
     if (VK_SUCCESS != result) {
-        throw std::runtime_error("Failed to queue image for presentation");
+        throw std::runtime_error("Failed to end command buffer");
     }
 }
 
-static VkSemaphore
-create_vulkan_semaphore(const VkDevice& logical_device)
+static std::uint32_t
+upload_instances(
+        const Game& game_state,
+        const GpuRing::Allocation& allocation)
 {
-    VkResult result;
-    VkSemaphore semaphore;
-    VkSemaphoreCreateInfo semaphore_info;
+    return scene_build_instances(
+            game_state,
+            static_cast<std::uint32_t*>(allocation.data));
+}
 
-    result = VK_ERROR_UNKNOWN;
-    semaphore = {};
-    semaphore_info = {};
+static struct PrerecordedCommands
+create_prerecorded_commands(
+        const VkDevice& logical_device,
+        const VkCommandPool& command_pool,
+        VkRenderPass& render_pass,
+        std::vector<VkFramebuffer>& swapchain_framebuffers,
+        VkExtent2D& swapchain_extent,
+        VkPipelineLayout& pipeline_layout,
+        VkPipeline& graphics_pipeline,
+        GpuRing& ring,
+        const Game& game_state)
+{
+    std::uint32_t instance_count;
+    struct PrerecordedCommands prerecorded;
 
-    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    instance_count = 0;
+    prerecorded = {};
 
-    result = vkCreateSemaphore(logical_device, &semaphore_info, nullptr, &semaphore);
+    prerecorded.command_buffers.resize(swapchain_framebuffers.size());
+    prerecorded.recorded_versions.resize(swapchain_framebuffers.size());
+    prerecorded.instance_regions.resize(swapchain_framebuffers.size());
+
+    for (uint32_t i = 0; i < swapchain_framebuffers.size(); i++) {
+        prerecorded.command_buffers[i] = create_command_buffer(
+                logical_device,
+                command_pool);
+
+        // Recorded commands keep referring to the region, so it can not come
+        // from the per frame part of the ring.
+        prerecorded.instance_regions[i] = ring.allocate_static(
+                g_instance_region_size,
+                g_instance_region_alignment);
+
+        instance_count = upload_instances(
+                game_state,
+                prerecorded.instance_regions[i]);
+
+        record_command_buffer(
+                prerecorded.command_buffers[i],
+                i,
+                render_pass,
+                swapchain_framebuffers,
+                swapchain_extent,
+                pipeline_layout,
+                graphics_pipeline,
+                ring.buffer(),
+                prerecorded.instance_regions[i].offset,
+                instance_count,
+                VK_NULL_HANDLE,
+                0);
+
+        prerecorded.recorded_versions[i] = game_state.version();
+    }
+
+    return prerecorded;
+}
+
+static std::uint64_t
+duration_ns(
+        std::chrono::steady_clock::time_point start,
+        std::chrono::steady_clock::time_point end)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+static struct GpuTimestamps
+create_gpu_timestamps(
+        const VkPhysicalDevice& physical_device,
+        const VkDevice& logical_device,
+        const struct QueueFamilyIndices& family_indices,
+        std::uint32_t frame_slot_count)
+{
+    VkResult result;
+    std::uint32_t queue_family_count;
+    std::uint32_t valid_bits;
+    std::vector<VkQueueFamilyProperties> queue_families;
+    VkPhysicalDeviceProperties properties;
+    VkQueryPoolCreateInfo pool_info;
+    struct GpuTimestamps timestamps;
+
+    result = VK_ERROR_UNKNOWN;
+    queue_family_count = 0;
+    properties = {};
+    pool_info = {};
+    timestamps = {};
+
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    vkGetPhysicalDeviceQueueFamilyProperties(
+            physical_device,
+            &queue_family_count,
+            nullptr);
+    queue_families.resize(queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(
+            physical_device,
+            &queue_family_count,
+            queue_families.data());
+
+    valid_bits = queue_families[family_indices.drawing_family].timestampValidBits;
+    if (0 == valid_bits) {
+        Log::w("Drawing queue does not support timestamps, no GPU timings");
+        return timestamps;
+    }
+
+    pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    pool_info.queryCount = frame_slot_count * 2;
+
+    result = vkCreateQueryPool(
+            logical_device,
+            &pool_info,
+            nullptr,
+            &timestamps.query_pool);
     if (VK_SUCCESS != result) {
-        throw std::runtime_error("Failed to create vulkan semaphore");
+        throw std::runtime_error("Failed to create timestamp query pool");
     }
 
-    return semaphore;
+    timestamps.period_ns = properties.limits.timestampPeriod;
+    timestamps.valid_mask = valid_bits >= 64 ? UINT64_MAX : (1ull << valid_bits) - 1;
+
+    return timestamps;
 }
 
-static VkFence
-create_vulkan_fence(const VkDevice& logical_device)
+// Called once the fence of the frame slot has signaled, so results are ready.
+static void
+collect_gpu_time(
+        const VkDevice& logical_device,
+        const struct GpuTimestamps& timestamps,
+        std::uint32_t frame_slot,
+        FrameStats& stats)
 {
     VkResult result;
-    VkFence fence;
-    VkFenceCreateInfo fence_info;
+    std::uint64_t ticks[2];
+
+    result = vkGetQueryPoolResults(
+            logical_device,
+            timestamps.query_pool,
+            frame_slot * 2,
+            2,
+            sizeof(ticks),
+            ticks,
+            sizeof(ticks[0]),
+            VK_QUERY_RESULT_64_BIT);
+    if (VK_SUCCESS != result) {
+        return;
+    }
+
+    stats.add(
+            FRAME_PHASE_GPU_RENDER,
+            static_cast<std::uint64_t>(
+                ((ticks[1] - ticks[0]) & timestamps.valid_mask) * timestamps.period_ns));
+}
+
+static std::vector<VkImage>
+get_swapchain_images(
+        const VkDevice& logical_device,
+        const VkSwapchainKHR& swapchain)
+{
+    std::uint32_t image_count;
+    std::vector<VkImage> images;
+
+    image_count = 0;
+    images.resize(0);
+
+    vkGetSwapchainImagesKHR(
+            logical_device,
+            swapchain,
+            &image_count,
+            nullptr);
+    images.resize(image_count);
+    vkGetSwapchainImagesKHR(
+            logical_device,
+            swapchain,
+            &image_count,
+            images.data());
+
+    return images;
+}
+
+static void
+destroy_retired_swapchain(
+        const VkDevice& logical_device,
+        struct RetiredSwapchain& retired)
+{
+    for (VkFramebuffer framebuffer : retired.framebuffers) {
+        vkDestroyFramebuffer(logical_device, framebuffer, nullptr);
+    }
+
+    for (VkImageView image_view : retired.image_views) {
+        vkDestroyImageView(logical_device, image_view, nullptr);
+    }
+
+    vkDestroySwapchainKHR(logical_device, retired.swapchain, nullptr);
+}
+
+/*
+ * Destroys retired swapchains once every submission made before retiring
+ * them has finished. Only polls fences, never waits.
+ */
+static void
+release_retired_swapchains(
+        const VkDevice& logical_device,
+        std::vector<struct FrameResources>& frames,
+        std::vector<struct RetiredSwapchain>& retired_swapchains)
+{
+    bool finished;
+
+    if (retired_swapchains.empty()) {
+        return;
+    }
+
+    // Fence is reset only right before submitting, so a signaled fence
+    // means the latest submission of the slot is done.
+    for (struct FrameResources& frame : frames) {
+        if (frame.submissions_finished != frame.submissions &&
+                VK_SUCCESS == vkGetFenceStatus(logical_device, frame.fence_in_flight)) {
+            frame.submissions_finished = frame.submissions;
+        }
+    }
+
+    while ( ! retired_swapchains.empty()) {
+        finished = true;
+        for (std::uint32_t i = 0; i < frames.size(); i++) {
+            if (frames[i].submissions_finished <
+                    retired_swapchains.front().frame_submissions[i]) {
+                finished = false;
+            }
+        }
+
+        if ( ! finished) {
+            return;
+        }
+
+        destroy_retired_swapchain(logical_device, retired_swapchains.front());
+        retired_swapchains.erase(retired_swapchains.begin());
+    }
+}
+
+/*
+ * Replaces the swapchain along with its image views and framebuffers. Render
+ * pass and graphics pipeline are kept, as viewport and scissor are dynamic
+ * state. Frames in flight are not waited for, the old swapchain is retired
+ * instead. Returns false without doing anything when the surface has no area,
+ * which is the case for a minimized window.
+ */
+static bool
+recreate_swapchain(
+        const VkPhysicalDevice& physical_device,
+        const VkDevice& logical_device,
+        const VkSurfaceKHR& surface,
+        SDL_Window* window,
+        VkPresentModeKHR preferred_present_mode,
+        VkRenderPass& render_pass,
+        const VkCommandPool& command_pool,
+        const std::vector<struct FrameResources>& frames,
+        VkSwapchainKHR& swapchain,
+        VkFormat& swapchain_image_format,
+        VkExtent2D& swapchain_extent,
+        std::vector<VkImage>& swapchain_images,
+        std::vector<VkImageView>& swapchain_image_views,
+        std::vector<VkFramebuffer>& swapchain_framebuffers,
+        std::vector<VkFence>& images_in_flight,
+        struct PrerecordedCommands& prerecorded,
+        GpuRing& ring,
+        std::vector<struct RetiredSwapchain>& retired_swapchains,
+        FrameStats& stats)
+{
+    VkResult result;
+    VkFormat previous_format;
+    VkExtent2D extent;
+    VkSurfaceCapabilitiesKHR capabilities;
+    struct RetiredSwapchain retired;
+
+    std::uint64_t stall_ns;
+    std::chrono::steady_clock::time_point time_start;
 
     result = VK_ERROR_UNKNOWN;
-    fence = {};
-    fence_info = {};
+    previous_format = swapchain_image_format;
+    extent = {};
+    capabilities = {};
+    retired = {};
+    stall_ns = 0;
 
-    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    time_start = std::chrono::steady_clock::now();
 
-    result = vkCreateFence(logical_device, &fence_info, nullptr, &fence);
+    result = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
+            physical_device,
+            surface,
+            &capabilities);
     if (VK_SUCCESS != result) {
-        throw std::runtime_error("Failed to create vulkan fence");
+        throw std::runtime_error("Failed to query surface capabilities");
     }
 
-    return fence;
+    extent = pick_swap_extent(capabilities, window);
+    if (0 == extent.width || 0 == extent.height) {
+        return false;
+    }
+
+    retired.swapchain = swapchain;
+    retired.image_views = std::move(swapchain_image_views);
+    retired.framebuffers = std::move(swapchain_framebuffers);
+    for (const struct FrameResources& frame : frames) {
+        retired.frame_submissions.push_back(frame.submissions);
+    }
+
+    swapchain = create_swap_chain(
+            physical_device,
+            logical_device,
+            surface,
+            window,
+            preferred_present_mode,
+            retired.swapchain,
+            swapchain_image_format,
+            swapchain_extent);
+    retired_swapchains.push_back(std::move(retired));
+
+    if (previous_format != swapchain_image_format) {
+        throw std::runtime_error(
+            "Swapchain image format changed, render pass is not compatible");
+    }
+
+    swapchain_images = get_swapchain_images(logical_device, swapchain);
+    swapchain_image_views = create_image_views(
+            logical_device,
+            swapchain_images,
+            swapchain_image_format);
+    swapchain_framebuffers = create_framebuffers(
+            logical_device,
+            swapchain_image_views,
+            render_pass,
+            swapchain_extent);
+
+    // Fences of existing indices are kept, prerecorded command buffers of
+    // those indices may still be executing.
+    images_in_flight.resize(swapchain_images.size(), VK_NULL_HANDLE);
+
+    if ( ! prerecorded.command_buffers.empty()) {
+        for (std::size_t i = prerecorded.command_buffers.size(); i < swapchain_images.size(); i++) {
+            prerecorded.command_buffers.push_back(create_command_buffer(
+                        logical_device,
+                        command_pool));
+            prerecorded.instance_regions.push_back(ring.allocate_static(
+                        g_instance_region_size,
+                        g_instance_region_alignment));
+        }
+
+        // Recorded commands refer to the old framebuffers, record again on
+        // next use.
+        prerecorded.recorded_versions.assign(
+                prerecorded.command_buffers.size(),
+                UINT64_MAX);
+    }
+
+    stall_ns = duration_ns(time_start, std::chrono::steady_clock::now());
+    stats.add(FRAME_PHASE_RECREATE, stall_ns);
+
+    LOG_I("Swapchain recreated at {}x{} with {} images in {} us",
+            swapchain_extent.width,
+            swapchain_extent.height,
+            swapchain_images.size(),
+            stall_ns / 1000);
+
+    return true;
+}
+
+/*
+ * Never blocks waiting for the GPU or for the presentation engine. Returns
+ * false without drawing if the previous frame is still in flight or no
+ * swapchain image is available yet, leaving the caller free to keep running
+ * the simulation.
+ *
+ * swapchain_stale is set when the swapchain no longer matches the surface.
+ * A suboptimal swapchain is still drawn to, an out of date one is not.
+ */
+static bool
+draw_frame(
+        VkDevice& logical_device,
+        struct FrameResources& frame,
+        std::vector<VkFence>& images_in_flight,
+        struct PrerecordedCommands& prerecorded,
+        const Game& game_state,
+        VkSwapchainKHR& swapchain,
+        VkRenderPass& render_pass,
+        std::vector<VkFramebuffer>& swapchain_framebuffers,
+        VkExtent2D& swapchain_extent,
+        VkPipelineLayout& pipeline_layout,
+        VkPipeline& graphics_pipeline,
+        GpuRing& ring,
+        const struct GpuTimestamps& timestamps,
+        FrameStats& stats,
+        VkQueue& drawing_queue,
+        VkQueue& presentation_queue,
+        bool& swapchain_stale)
+{
+    VkResult result;
+    VkSubmitInfo submit_info;
+    VkPresentInfoKHR present_info;
+    VkSemaphore wait_semaphores[1];
+    VkSemaphore signal_semaphores[1];
+    VkPipelineStageFlags wait_stages[1];
+    VkSwapchainKHR swapchains[1];
+
+    uint32_t image_index;
+    uint32_t flags;
+    std::uint32_t instance_count;
+
+    VkCommandBuffer command_buffer;
+    GpuRing::Allocation instance_region;
+
+    std::chrono::steady_clock::time_point time_start;
+    std::chrono::steady_clock::time_point time_acquired;
+    std::chrono::steady_clock::time_point time_recorded;
+    std::chrono::steady_clock::time_point time_submitted;
+    std::chrono::steady_clock::time_point time_presented;
+
+    result = VK_ERROR_UNKNOWN;
+    submit_info = {};
+    present_info = {};
+    command_buffer = VK_NULL_HANDLE;
+    instance_region = {};
+    swapchains[0] = swapchain;
+    wait_semaphores[0] = frame.semaphore_image_available;
+    signal_semaphores[0] = frame.semaphore_render_finished;
+    wait_stages[0] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+
+    flags = 0;
+    image_index = -1;
+    instance_count = 0;
+
+    result = vkGetFenceStatus(logical_device, frame.fence_in_flight);
+    if (VK_NOT_READY == result) {
+        return false;
+    }
+    if (VK_SUCCESS != result) {
+        throw std::runtime_error("Failed to query status of in flight fence");
+    }
+
+    frame.submissions_finished = frame.submissions;
+
+    if (frame.timestamps_pending) {
+        collect_gpu_time(logical_device, timestamps, frame.slot, stats);
+        frame.timestamps_pending = false;
+    }
+
+    time_start = std::chrono::steady_clock::now();
+
+    result = vkAcquireNextImageKHR(
+            logical_device,
+            swapchain,
+            0,
+            frame.semaphore_image_available,
+            VK_NULL_HANDLE,
+            &image_index);
+    if (VK_NOT_READY == result || VK_TIMEOUT == result) {
+        return false;
+    }
+    if (VK_ERROR_OUT_OF_DATE_KHR == result) {
+        // Nothing was acquired, semaphore and fence are left untouched.
+        swapchain_stale = true;
+        return false;
+    }
+    if (VK_SUBOPTIMAL_KHR == result) {
+        swapchain_stale = true;
+    } else if (VK_SUCCESS != result) {
+        throw std::runtime_error(
+            "Failed to retrieve index of next available presentable image");
+    }
+
+    // With more frames in flight than there are swapchain images, the image
+    // may still be rendered to by an earlier frame.
+    if (VK_NULL_HANDLE != images_in_flight[image_index]) {
+        vkWaitForFences(
+                logical_device,
+                1,
+                &images_in_flight[image_index],
+                VK_TRUE,
+                UINT64_MAX);
+    }
+    images_in_flight[image_index] = frame.fence_in_flight;
+
+    vkResetFences(logical_device, 1, &frame.fence_in_flight);
+
+    // Fence had signaled, ring regions of the previous use of this frame
+    // slot are free again. Not before acquiring succeeds, as a failed
+    // attempt leaves the fence signaled and the slot gets begun again on
+    // the next one, which would free regions of other frames in flight.
+    ring.begin_frame(frame.slot);
+
+    time_acquired = std::chrono::steady_clock::now();
+
+    if (prerecorded.command_buffers.empty()) {
+        command_buffer = frame.command_buffer;
+
+        instance_region = ring.allocate(
+                g_instance_region_size,
+                g_instance_region_alignment);
+        instance_count = upload_instances(game_state, instance_region);
+
+        vkResetCommandBuffer(command_buffer, flags);
+
+        record_command_buffer(
+                command_buffer,
+                image_index,
+                render_pass,
+                swapchain_framebuffers,
+                swapchain_extent,
+                pipeline_layout,
+                graphics_pipeline,
+                ring.buffer(),
+                instance_region.offset,
+                instance_count,
+                timestamps.query_pool,
+                frame.slot * 2);
+        frame.timestamps_pending = VK_NULL_HANDLE != timestamps.query_pool;
+    } else {
+        command_buffer = prerecorded.command_buffers[image_index];
+
+        // Image fence was waited for above, so neither the command buffer nor
+        // the instance data of the image are in use and may be written.
+        if (prerecorded.recorded_versions[image_index] != game_state.version()) {
+            instance_count = upload_instances(
+                    game_state,
+                    prerecorded.instance_regions[image_index]);
+
+            vkResetCommandBuffer(command_buffer, flags);
+
+            record_command_buffer(
+                    command_buffer,
+                    image_index,
+                    render_pass,
+                    swapchain_framebuffers,
+                    swapchain_extent,
+                    pipeline_layout,
+                    graphics_pipeline,
+                    ring.buffer(),
+                    prerecorded.instance_regions[image_index].offset,
+                    instance_count,
+                    VK_NULL_HANDLE,
+                    0);
+
+            prerecorded.recorded_versions[image_index] = game_state.version();
+        }
+    }
+
+    time_recorded = std::chrono::steady_clock::now();
+
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.waitSemaphoreCount = 1;
+    submit_info.pWaitSemaphores = wait_semaphores;
+    submit_info.pWaitDstStageMask = wait_stages;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &command_buffer;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = signal_semaphores;
+
+    present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    present_info.waitSemaphoreCount = 1;
+    present_info.pWaitSemaphores = signal_semaphores;
+    present_info.swapchainCount = 1;
+    present_info.pSwapchains = swapchains;
+    present_info.pImageIndices = &image_index;
+
+    result = vkQueueSubmit(drawing_queue, 1, &submit_info, frame.fence_in_flight);
+    if (VK_SUCCESS != result) {
+        throw std::runtime_error("Failed to submit draw command buffer");
+    }
+    frame.submissions++;
+
+    time_submitted = std::chrono::steady_clock::now();
+
+    // Semaphore wait happens even when out of date, so the frame is done.
+    result = vkQueuePresentKHR(presentation_queue, &present_info);
+    if (VK_ERROR_OUT_OF_DATE_KHR == result || VK_SUBOPTIMAL_KHR == result) {
+        swapchain_stale = true;
+    } else if (VK_SUCCESS != result) {
+        throw std::runtime_error("Failed to queue image for presentation");
+    }
+
+    time_presented = std::chrono::steady_clock::now();
+
+    stats.add(FRAME_PHASE_ACQUIRE, duration_ns(time_start, time_acquired));
+    stats.add(FRAME_PHASE_RECORD, duration_ns(time_acquired, time_recorded));
+    stats.add(FRAME_PHASE_SUBMIT, duration_ns(time_recorded, time_submitted));
+    stats.add(FRAME_PHASE_PRESENT, duration_ns(time_submitted, time_presented));
+    stats.add(FRAME_PHASE_CPU_TOTAL, duration_ns(time_start, time_presented));
+
+    return true;
+}
+
+static VkSemaphore
+create_vulkan_semaphore(const VkDevice& logical_device)
+{
+    VkResult result;
+    VkSemaphore semaphore;
+    VkSemaphoreCreateInfo semaphore_info;
+
+    result = VK_ERROR_UNKNOWN;
+    semaphore = {};
+    semaphore_info = {};
+
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    result = vkCreateSemaphore(logical_device, &semaphore_info, nullptr, &semaphore);
+    if (VK_SUCCESS != result) {
+        throw std::runtime_error("Failed to create vulkan semaphore");
+    }
+
+    return semaphore;
+}
+
+static VkFence
+create_vulkan_fence(const VkDevice& logical_device)
+{
+    VkResult result;
+    VkFence fence;
+    VkFenceCreateInfo fence_info;
+
+    result = VK_ERROR_UNKNOWN;
+    fence = {};
+    fence_info = {};
+
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    result = vkCreateFence(logical_device, &fence_info, nullptr, &fence);
+    if (VK_SUCCESS != result) {
+        throw std::runtime_error("Failed to create vulkan fence");
+    }
+
+    return fence;
+}
+
+/*
+ * Returns false when the game should quit.
+ */
+static bool
+handle_events(bool& swapchain_stale)
+{
+    SDL_Event event;
+
+    // Game keys are taken care of by Input, as events get pumped.
+    while (SDL_PollEvent(&event)) {
+        if (SDL_QUIT == event.type) {
+            return false;
+        }
+
+        // Not every platform reports a resize through the swapchain.
+        if (SDL_WINDOWEVENT == event.type) {
+            if (SDL_WINDOWEVENT_SIZE_CHANGED == event.window.event) {
+                swapchain_stale = true;
+            }
+            continue;
+        }
+
+        if (SDL_KEYDOWN == event.type &&
+                SDL_SCANCODE_ESCAPE == event.key.keysym.scancode) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static GameSettings
+get_game_settings(const struct Options& options)
+{
+    GameSettings settings;
+
+    settings = Game::default_settings();
+    settings.randomizer = options.randomizer;
+
+    return settings;
+}
+
+/*
+ * Starts playback or recording of a replay when asked to. Playback replaces
+ * game with the one recorded.
+ */
+static void
+start_replay(
+        const struct Options& options,
+        Game& game_state,
+        ReplayPlayer& player,
+        ReplayRecorder& recorder)
+{
+    if ( ! options.replay_path.empty()) {
+        player.open(options.replay_path);
+        if (options.replay_keyframe >= player.keyframe_count()) {
+            throw std::runtime_error("--replay-keyframe out of range");
+        }
+
+        game_state = player.create_game();
+        player.seek(game_state, options.replay_keyframe);
+
+        LOG_I("Playing {} from keyframe {} of {}, tick {} of {}",
+                options.replay_path,
+                options.replay_keyframe,
+                player.keyframe_count(),
+                game_state.ticks(),
+                player.header().tick_count);
+    } else if ( ! options.record_path.empty()) {
+        recorder.start(game_state, g_replay_keyframe_interval);
+    }
+}
+
+static void
+start_bot(const struct Options& options, const ReplayPlayer& player, Bot& bot)
+{
+    if ( ! options.bot || player.is_open()) {
+        return;
+    }
+
+    bot.start(options.bot_settings);
+
+    LOG_I("Bot playing with beam width {}, {} us budget, {} threads",
+            options.bot_settings.beam_width,
+            options.bot_settings.budget.count(),
+            bot.thread_count());
+}
+
+/*
+ * Returns exit status of the process, which is non-zero only when a startup
+ * budget was given and the first frame took longer than that.
+ */
+static int
+game(const struct Options& options)
+{
+    std::int32_t ret;
+    int exit_status;
+    std::uint32_t flags;
+
+    std::uint32_t extension_count;
+    std::vector<const char*> extension_names;
+    std::vector<VkFramebuffer> swapchain_framebuffers;
+
+    std::string hint_name;
+    std::string hint_value;
+
+    std::int32_t window_x;
+    std::int32_t window_y;
+    std::int32_t window_w;
+    std::int32_t window_h;
+    std::uint32_t window_flags;
+    std::string window_title;
+
+    struct QueueFamilyIndices family_indices;
+
+    SDL_Window* main_window;
+
+    VkInstance vulkan_instance;
+    VkPhysicalDevice physical_device;
+    VkDevice logical_device;
+    VkQueue drawing_queue;
+    VkQueue presentation_queue;
+    VkSurfaceKHR surface;
+    VkSwapchainKHR swapchain;
+    VkFormat swapchain_image_format;
+    VkExtent2D swapchain_extent;
+    VkRenderPass render_pass;
+    VkPipelineLayout pipeline_layout;
+    VkPipeline graphics_pipeline;
+    VkCommandPool command_pool;
+
+    PipelineCache pipeline_cache;
+    StartupProfiler startup_profiler;
+    struct GpuTimestamps timestamps;
+    FrameStats frame_stats;
+    std::chrono::steady_clock::time_point pipeline_creation_start;
+
+    std::vector<struct FrameResources> frames;
+    std::vector<VkFence> images_in_flight;
+    std::uint32_t frame_index;
+
+    struct PrerecordedCommands prerecorded;
+    GpuRing ring;
+
+    std::vector<VkImageView> swapchain_image_views;
+    std::vector<VkImage> swapchain_images;
+    std::vector<struct RetiredSwapchain> retired_swapchains;
+    bool swapchain_stale;
+
+    bool running;
+    std::int32_t ticks_run;
+    std::chrono::steady_clock::time_point time_previous;
+    std::chrono::steady_clock::time_point time_now;
+    std::chrono::steady_clock::duration time_accumulated;
+    std::chrono::steady_clock::duration frame_period;
+    std::chrono::steady_clock::time_point frame_deadline;
+    std::chrono::steady_clock::time_point tick_end;
+    std::chrono::steady_clock::time_point input_time;
+    std::chrono::steady_clock::time_point input_simulated_time;
+
+    Input input;
+    ReplayPlayer player;
+    ReplayRecorder recorder;
+    Bot bot;
+
+    const std::chrono::steady_clock::duration tick_duration =
+        std::chrono::nanoseconds(1000000000 / GAME_TICK_RATE);
+
+    Game game_state(get_game_settings(options), options.seed);
+
+    ret = -1;
+    exit_status = 0;
+    flags = 0;
+
+    extension_count = 0;
+    extension_names.resize(0);
+    swapchain_framebuffers.resize(0);
+
+    hint_name = SDL_HINT_RENDER_SCALE_QUALITY;
+    hint_value = "1";
+
+    window_x = SDL_WINDOWPOS_UNDEFINED;
+    window_y = SDL_WINDOWPOS_UNDEFINED;
+    window_w = 640;
+    window_h = 480;
+    window_flags = SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE;
+    window_title = g_program_name;
+
+    vulkan_instance = {};
+    physical_device = VK_NULL_HANDLE;
+    logical_device = VK_NULL_HANDLE;
+    drawing_queue = VK_NULL_HANDLE;
+    presentation_queue = VK_NULL_HANDLE;
+    surface = VK_NULL_HANDLE;
+    swapchain = VK_NULL_HANDLE;
+    swapchain_image_format = VK_FORMAT_UNDEFINED;
+    swapchain_extent = {};
+    render_pass = {};
+    pipeline_layout = {};
+    graphics_pipeline = {};
+    command_pool = {};
+
+    swapchain_image_views.resize(0);
+    swapchain_images.resize(0);
+    retired_swapchains.resize(0);
+    swapchain_stale = false;
+
+    family_indices = {0};
+
+    frames.resize(0);
+    images_in_flight.resize(0);
+    frame_index = 0;
+    prerecorded = {};
+    timestamps = {};
+
+    running = true;
+    ticks_run = 0;
+    time_accumulated = {};
+    frame_period = {};
+    input_time = {};
+    input_simulated_time = {};
+
+    if (0 != options.fps_limit) {
+        frame_period = std::chrono::nanoseconds(1000000000 / options.fps_limit);
+        LOG_I("Frame rate limited to {} fps", options.fps_limit);
+    }
+
+    LOG_I("{} running", g_program_name);
+
+    flags = SDL_INIT_VIDEO;
+    ret = SDL_Init(flags);
+    if (ret < 0) {
+        g_msg_temp = "Failed to initialize SDL: ";
+        g_msg_temp += SDL_GetError();
+        throw std::runtime_error(g_msg_temp);
+    }
+    startup_profiler.mark("SDL_Init");
+
+    ret = SDL_SetHint(hint_name.c_str(), hint_value.c_str());
+    if (SDL_FALSE == ret) {
+        LOG_W("Setting SDL hint {} failed", hint_name);
+    }
+
+    main_window = SDL_CreateWindow(
+            window_title.c_str(),
+            window_x,
+            window_y,
+            window_w,
+            window_h,
+            window_flags);
+    if (NULL == main_window) {
+        g_msg_temp = "Failed to create window: ";
+        g_msg_temp += SDL_GetError();
+        throw std::runtime_error(g_msg_temp);
+    }
+    startup_profiler.mark("SDL_CreateWindow");
+
+    SDL_Vulkan_GetInstanceExtensions(main_window, &extension_count, nullptr);
+    extension_names.resize(extension_count);
+    SDL_Vulkan_GetInstanceExtensions(main_window, &extension_count, extension_names.data());
+
+    vulkan_instance = create_instance(extension_names);
+    startup_profiler.mark("vkCreateInstance");
+
+    surface = create_surface(main_window, &vulkan_instance);
+    startup_profiler.mark("create_surface");
+
+    physical_device = pick_physical_device(&vulkan_instance, surface);
+    startup_profiler.mark("pick_physical_device");
+
+    family_indices = find_queue_family_indices(physical_device, surface);
+    logical_device = create_logical_device(physical_device, family_indices, true);
+    vkGetDeviceQueue(
+            logical_device,
+            family_indices.drawing_family,
+            0,
+            &drawing_queue);
+    vkGetDeviceQueue(
+            logical_device,
+            family_indices.presentation_family,
+            0,
+            &presentation_queue);
+    startup_profiler.mark("create_logical_device");
+
+    swapchain = create_swap_chain(
+            physical_device,
+            logical_device,
+            surface,
+            main_window,
+            options.present_mode,
+            VK_NULL_HANDLE,
+            swapchain_image_format,
+            swapchain_extent);
+    swapchain_images = get_swapchain_images(logical_device, swapchain);
+
+    swapchain_image_views = create_image_views(
+            logical_device,
+            swapchain_images,
+            swapchain_image_format);
+    startup_profiler.mark("swapchain");
+
+    render_pass = create_render_pass(
+            logical_device,
+            swapchain_image_format,
+            VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+    pipeline_layout = create_pipeline_layout(logical_device);
+
+    pipeline_cache.load(physical_device, logical_device);
+
+    Log::i("Creating Vulkan graphics pipeline");
+    pipeline_creation_start = std::chrono::steady_clock::now();
+    graphics_pipeline = create_graphics_pipeline(
+            logical_device,
+            swapchain_extent,
+            pipeline_layout,
+            render_pass,
+            pipeline_cache.handle());
+
+    LOG_I("Graphics pipeline created in {} us with {} pipeline cache",
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - pipeline_creation_start).count(),
+            pipeline_cache.warm() ? "warm" : "cold");
+    startup_profiler.mark("pipeline");
+
+    swapchain_framebuffers = create_framebuffers(
+            logical_device,
+            swapchain_image_views,
+            render_pass,
+            swapchain_extent);
+    startup_profiler.mark("framebuffers");
+
+    command_pool = create_command_pool(
+            logical_device,
+            family_indices);
+
+    LOG_I("Frames in flight: {}", options.frames_in_flight);
+
+    frames.resize(options.frames_in_flight);
+    for (std::uint32_t i = 0; i < frames.size(); i++) {
+        struct FrameResources& frame = frames[i];
+
+        frame.slot = i;
+        frame.command_buffer = create_command_buffer(
+                logical_device,
+                command_pool);
+        frame.semaphore_image_available = create_vulkan_semaphore(logical_device);
+        frame.semaphore_render_finished = create_vulkan_semaphore(logical_device);
+        frame.fence_in_flight = create_vulkan_fence(logical_device);
+        frame.timestamps_pending = false;
+        frame.submissions = 0;
+        frame.submissions_finished = 0;
+    }
+
+    timestamps = create_gpu_timestamps(
+            physical_device,
+            logical_device,
+            family_indices,
+            options.frames_in_flight);
+
+    images_in_flight.resize(swapchain_images.size(), VK_NULL_HANDLE);
+
+    /*
+     * Ring part has room for one more frame than can be in flight, so that
+     * the frame being recorded never has to wait for space. Static part is
+     * only needed by prerecorded command buffers, with room for a recreated
+     * swapchain to have more images.
+     */
+    ring.create(
+            physical_device,
+            logical_device,
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            options.prerecord ?
+                2 * swapchain_images.size() * g_instance_region_size : 0,
+            (options.frames_in_flight + 1) * g_instance_region_size,
+            options.frames_in_flight);
+
+    if (options.prerecord) {
+        Log::i("Pre-recording command buffers per swapchain framebuffer");
+        prerecorded = create_prerecorded_commands(
+                logical_device,
+                command_pool,
+                render_pass,
+                swapchain_framebuffers,
+                swapchain_extent,
+                pipeline_layout,
+                graphics_pipeline,
+                ring,
+                game_state);
+    }
+    startup_profiler.mark("frame resources");
+
+    /*
+     * Simulation advances in fixed ticks regardless of how fast frames can be
+     * presented. Key transitions are applied to the tick they happened in by
+     * their timestamps, so input timing does not depend on when the loop got
+     * around to running the tick. Drawing never blocks. Frames are presented
+     * as fast as the presentation engine accepts them and show the latest
+     * simulated state.
+     *
+     * A stale swapchain is recreated before drawing the next frame. While
+     * the window is minimized there is nothing to draw to.
+     *
+     * With a frame rate limit the wait happens before running ticks, so that
+     * the frame shows the latest input rather than input from before the
+     * wait.
+     */
+    start_replay(options, game_state, player, recorder);
+    start_bot(options, player, bot);
+    if ( ! player.is_open() && ! bot.active()) {
+        input.start();
+    }
+
+    time_previous = std::chrono::steady_clock::now();
+    frame_deadline = time_previous;
+    while (running) {
+        if (0 != options.fps_limit) {
+            input_wait_until(frame_deadline);
+        }
+
+        running = handle_events(swapchain_stale);
+
+        time_now = std::chrono::steady_clock::now();
+        time_accumulated += time_now - time_previous;
+        time_previous = time_now;
+
+        // Simulated time lags behind by what is left in the accumulator.
+        tick_end = time_now - time_accumulated + tick_duration;
+
+        ticks_run = 0;
+        while (time_accumulated >= tick_duration) {
+            if (player.is_open()) {
+                // Nothing left to simulate once the recording ends.
+                if ( ! player.apply(game_state)) {
+                    time_accumulated = {};
+                    break;
+                }
+            } else if (bot.active()) {
+                bot.play(game_state, recorder.active() ? &recorder : nullptr);
+            } else {
+                input_time = input.apply(
+                        game_state,
+                        tick_end,
+                        tick_duration,
+                        recorder.active() ? &recorder : nullptr);
+                if (std::chrono::steady_clock::time_point() == input_simulated_time) {
+                    input_simulated_time = input_time;
+                }
+            }
+
+            game_state.tick();
+            recorder.record_tick(game_state);
+            time_accumulated -= tick_duration;
+            tick_end += tick_duration;
+
+            if (++ticks_run >= g_max_catch_up_ticks) {
+                time_accumulated = {};
+                break;
+            }
+        }
+
+        release_retired_swapchains(logical_device, frames, retired_swapchains);
+
+        if (swapchain_stale) {
+            swapchain_stale = ! recreate_swapchain(
+                    physical_device,
+                    logical_device,
+                    surface,
+                    main_window,
+                    options.present_mode,
+                    render_pass,
+                    command_pool,
+                    frames,
+                    swapchain,
+                    swapchain_image_format,
+                    swapchain_extent,
+                    swapchain_images,
+                    swapchain_image_views,
+                    swapchain_framebuffers,
+                    images_in_flight,
+                    prerecorded,
+                    ring,
+                    retired_swapchains,
+                    frame_stats);
+        }
+
+        if ( ! swapchain_stale && draw_frame(
+                logical_device,
+                frames[frame_index],
+                images_in_flight,
+                prerecorded,
+                game_state,
+                swapchain,
+                render_pass,
+                swapchain_framebuffers,
+                swapchain_extent,
+                pipeline_layout,
+                graphics_pipeline,
+                ring,
+                timestamps,
+                frame_stats,
+                drawing_queue,
+                presentation_queue,
+                swapchain_stale)) {
+            frame_index = (frame_index + 1) % frames.size();
+            time_now = std::chrono::steady_clock::now();
+
+            if (std::chrono::steady_clock::time_point() != input_simulated_time) {
+                frame_stats.add(
+                        FRAME_PHASE_INPUT_LATENCY,
+                        duration_ns(input_simulated_time, time_now));
+                input_simulated_time = {};
+            }
+
+            if (0 != options.fps_limit) {
+                // Start over from now after falling behind, instead of
+                // drawing a burst of frames to catch up.
+                frame_deadline += frame_period;
+                if (frame_deadline < time_now) {
+                    frame_deadline = time_now;
+                }
+            }
+
+            if ( ! startup_profiler.first_frame_done()) {
+                startup_profiler.mark_first_frame();
+                // With a budget the run is a startup measurement only.
+                running = running && 0 == options.startup_budget_ms;
+            }
+        } else {
+            // No free frame or swapchain image yet, or nothing to draw to,
+            // check back soon but do not oversleep the next tick.
+            std::this_thread::sleep_for(std::min(
+                        tick_duration - time_accumulated,
+                        g_frame_poll_interval));
+        }
+    }
+
+    if (bot.active()) {
+        bot.stop();
+    } else if ( ! player.is_open()) {
+        input.stop();
+    }
+
+    if (recorder.active()) {
+        recorder.write(options.record_path);
+        LOG_I("Replay written to {}", options.record_path);
+    }
+
+    vkDeviceWaitIdle(logical_device);
+
+    pipeline_cache.save(logical_device);
+
+    LOG_I("{} shutting down", g_program_name);
+
+    for (struct FrameResources& frame : frames) {
+        vkDestroySemaphore(logical_device, frame.semaphore_image_available, nullptr);
+        vkDestroySemaphore(logical_device, frame.semaphore_render_finished, nullptr);
+        vkDestroyFence(logical_device, frame.fence_in_flight, nullptr);
+    }
+
+    vkDestroyCommandPool(logical_device, command_pool, nullptr);
+
+    if (VK_NULL_HANDLE != timestamps.query_pool) {
+        vkDestroyQueryPool(logical_device, timestamps.query_pool, nullptr);
+    }
+
+    ring.destroy(logical_device);
+
+    for (VkFramebuffer framebuffer : swapchain_framebuffers) {
+        vkDestroyFramebuffer(logical_device, framebuffer, nullptr);
+    }
+
+    vkDestroyPipeline(logical_device, graphics_pipeline, nullptr);
+    pipeline_cache.destroy(logical_device);
+    vkDestroyPipelineLayout(logical_device, pipeline_layout, nullptr);
+    vkDestroyRenderPass(logical_device, render_pass, nullptr);
+
+    for (VkImageView image_view : swapchain_image_views) {
+        vkDestroyImageView(logical_device, image_view, nullptr);
+    }
+
+    for (struct RetiredSwapchain& retired : retired_swapchains) {
+        destroy_retired_swapchain(logical_device, retired);
+    }
+
+    vkDestroySwapchainKHR(logical_device, swapchain, nullptr);
+    vkDestroyDevice(logical_device, nullptr);
+    vkDestroySurfaceKHR(vulkan_instance, surface, nullptr);
+    vkDestroyInstance(vulkan_instance, nullptr);
+
+    SDL_Quit();
+
+    startup_profiler.report();
+
+    frame_stats.log();
+    if ( ! options.frame_stats_path.empty()) {
+        frame_stats.write_csv(options.frame_stats_path);
+    }
+
+    if (0 != options.startup_budget_ms &&
+            startup_profiler.time_to_first_frame() >
+            std::chrono::milliseconds(options.startup_budget_ms)) {
+        LOG_E("Time to first frame exceeded budget of {} ms",
+                options.startup_budget_ms);
+        exit_status = 1;
+    }
+
+    Log::stop();
+
+    return exit_status;
+}
+
+static struct OffscreenTarget
+create_offscreen_target(
+        const VkPhysicalDevice& physical_device,
+        const VkDevice& logical_device,
+        const VkRenderPass& render_pass)
+{
+    VkResult result;
+    VkImageCreateInfo image_info;
+    VkBufferCreateInfo buffer_info;
+    VkMemoryAllocateInfo allocate_info;
+    VkMemoryRequirements requirements;
+    struct OffscreenTarget target;
+
+    result = VK_ERROR_UNKNOWN;
+    image_info = {};
+    buffer_info = {};
+    allocate_info = {};
+    requirements = {};
+    target = {};
+
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = g_offscreen_format;
+    image_info.extent = { g_offscreen_extent.width, g_offscreen_extent.height, 1 };
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage =
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+        VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    result = vkCreateImage(logical_device, &image_info, nullptr, &target.image);
+    if (VK_SUCCESS != result) {
+        throw std::runtime_error("Failed to create offscreen image");
+    }
+
+    vkGetImageMemoryRequirements(logical_device, target.image, &requirements);
+
+    allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocate_info.allocationSize = requirements.size;
+    allocate_info.memoryTypeIndex = gpu_find_memory_type(
+            physical_device,
+            requirements.memoryTypeBits,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    result = vkAllocateMemory(
+            logical_device,
+            &allocate_info,
+            nullptr,
+            &target.image_memory);
+    if (VK_SUCCESS != result) {
+        throw std::runtime_error("Failed to allocate offscreen image memory");
+    }
+
+    vkBindImageMemory(logical_device, target.image, target.image_memory, 0);
+
+    target.image_views = create_image_views(
+            logical_device,
+            { target.image },
+            g_offscreen_format);
+    target.framebuffers = create_framebuffers(
+            logical_device,
+            target.image_views,
+            render_pass,
+            g_offscreen_extent);
+
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size =
+        g_offscreen_extent.width *
+        g_offscreen_extent.height *
+        g_offscreen_bytes_per_pixel;
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    result = vkCreateBuffer(
+            logical_device,
+            &buffer_info,
+            nullptr,
+            &target.readback_buffer);
+    if (VK_SUCCESS != result) {
+        throw std::runtime_error("Failed to create readback buffer");
+    }
+
+    vkGetBufferMemoryRequirements(
+            logical_device,
+            target.readback_buffer,
+            &requirements);
+
+    allocate_info.allocationSize = requirements.size;
+    allocate_info.memoryTypeIndex = gpu_find_memory_type(
+            physical_device,
+            requirements.memoryTypeBits,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    result = vkAllocateMemory(
+            logical_device,
+            &allocate_info,
+            nullptr,
+            &target.readback_memory);
+    if (VK_SUCCESS != result) {
+        throw std::runtime_error("Failed to allocate readback memory");
+    }
+
+    vkBindBufferMemory(
+            logical_device,
+            target.readback_buffer,
+            target.readback_memory,
+            0);
+
+    result = vkMapMemory(
+            logical_device,
+            target.readback_memory,
+            0,
+            VK_WHOLE_SIZE,
+            0,
+            &target.readback_data);
+    if (VK_SUCCESS != result) {
+        throw std::runtime_error("Failed to map readback memory");
+    }
+
+    return target;
+}
+
+static void
+destroy_offscreen_target(
+        const VkDevice& logical_device,
+        struct OffscreenTarget& target)
+{
+    vkUnmapMemory(logical_device, target.readback_memory);
+    vkDestroyBuffer(logical_device, target.readback_buffer, nullptr);
+    vkFreeMemory(logical_device, target.readback_memory, nullptr);
+
+    for (VkFramebuffer framebuffer : target.framebuffers) {
+        vkDestroyFramebuffer(logical_device, framebuffer, nullptr);
+    }
+
+    for (VkImageView image_view : target.image_views) {
+        vkDestroyImageView(logical_device, image_view, nullptr);
+    }
+
+    vkDestroyImage(logical_device, target.image, nullptr);
+    vkFreeMemory(logical_device, target.image_memory, nullptr);
+
+    target = {};
+}
+
+/*
+ * Copies the rendered image into the readback buffer and makes the copy
+ * visible to the host once the submission has completed.
+ */
+static void
+record_offscreen_readback(
+        VkCommandBuffer command_buffer,
+        const struct OffscreenTarget& target)
+{
+    VkBufferImageCopy region;
+    VkBufferMemoryBarrier barrier;
+
+    region = {};
+    barrier = {};
+
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = { 0, 0, 0 };
+    region.imageExtent = { g_offscreen_extent.width, g_offscreen_extent.height, 1 };
+
+    vkCmdCopyImageToBuffer(
+            command_buffer,
+            target.image,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            target.readback_buffer,
+            1,
+            &region);
+
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = target.readback_buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(
+            command_buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT,
+            0,
+            0,
+            nullptr,
+            1,
+            &barrier,
+            0,
+            nullptr);
 }
 
-static void
-game(void)
+static std::string
+get_headless_frame_path(const struct Options& options, std::uint32_t frame)
 {
-    std::int32_t ret;
-    std::uint32_t flags;
-
-    std::uint32_t extension_count;
-    std::vector<const char*> extension_names;
-    std::vector<VkFramebuffer> swapchain_framebuffers;
-
-    std::string hint_name;
-    std::string hint_value;
-
-    std::int32_t window_x;
-    std::int32_t window_y;
-    std::int32_t window_w;
-    std::int32_t window_h;
-    std::uint32_t window_flags;
-    std::string window_title;
+    char name[32];
 
-    struct QueueFamilyIndices family_indices;
-
-    SDL_Window* main_window;
+    std::snprintf(
+            name,
+            sizeof(name),
+            "frame_%06u.%s",
+            frame,
+            options.headless_raw ? "rgba" : "png");
 
-    VkApplicationInfo application_info;
-    VkInstanceCreateInfo create_info;
+    return options.headless_directory + "/" + name;
+}
 
+/*
+ * Runs the simulation without a window, rendering a frame into an offscreen
+ * image every headless_ticks ticks and writing it into headless_directory.
+ * Needs no surface nor presentation support, so that any Vulkan device works,
+ * including software implementations.
+ */
+static int
+headless(const struct Options& options)
+{
     VkResult result;
     VkInstance vulkan_instance;
     VkPhysicalDevice physical_device;
     VkDevice logical_device;
     VkQueue drawing_queue;
-    VkQueue presentation_queue;
-    VkSurfaceKHR surface;
-    VkSwapchainKHR swapchain;
-    VkFormat swapchain_image_format;
-    VkExtent2D swapchain_extent;
     VkRenderPass render_pass;
     VkPipelineLayout pipeline_layout;
     VkPipeline graphics_pipeline;
     VkCommandPool command_pool;
     VkCommandBuffer command_buffer;
+    VkCommandBufferBeginInfo begin_info;
+    VkSubmitInfo submit_info;
+    VkFence fence;
+    VkExtent2D extent;
 
-    VkSemaphore semaphore_image_available;
-    VkSemaphore semaphore_render_finished;
-    VkFence fence_in_flight;
+    struct QueueFamilyIndices family_indices;
+    struct OffscreenTarget target;
 
-    std::vector<VkImageView> swapchain_image_views;
-    std::vector<VkImage> swapchain_images;
-    std::uint32_t swapchain_image_count;
+    PipelineCache pipeline_cache;
+    GpuRing ring;
+    GpuRing::Allocation instance_region;
+    VkBuffer instance_buffer;
+    std::uint32_t instance_count;
 
-    const std::string application_name = g_program_name;
-    const std::string engine_name = "No engine";
+    std::string path;
+    std::chrono::steady_clock::time_point time_start;
+    double elapsed_ms;
 
-    ret = -1;
-    flags = 0;
+    Game game_state(get_game_settings(options), options.seed);
+    ReplayPlayer player;
+    ReplayRecorder recorder;
+    Bot bot;
 
-    extension_count = 0;
-    extension_names.resize(0);
-    swapchain_framebuffers.resize(0);
+    result = VK_ERROR_UNKNOWN;
+    begin_info = {};
+    submit_info = {};
+    family_indices = {0};
+    extent = g_offscreen_extent;
+    instance_count = 0;
 
-    hint_name = SDL_HINT_RENDER_SCALE_QUALITY;
-    hint_value = "1";
+    LOG_I("{} running headless, writing {} frames into {}",
+            g_program_name,
+            options.headless_frames,
+            options.headless_directory);
 
-    window_x = SDL_WINDOWPOS_UNDEFINED;
-    window_y = SDL_WINDOWPOS_UNDEFINED;
-    window_w = 640;
-    window_h = 480;
-    window_flags = SDL_WINDOW_VULKAN;
-    window_title = g_program_name;
+    start_replay(options, game_state, player, recorder);
+    start_bot(options, player, bot);
 
-    application_info = {};
-    create_info = {};
+    vulkan_instance = create_instance({});
+    physical_device = pick_physical_device(&vulkan_instance, VK_NULL_HANDLE);
+    family_indices = find_queue_family_indices(physical_device, VK_NULL_HANDLE);
+    logical_device = create_logical_device(physical_device, family_indices, false);
+    vkGetDeviceQueue(
+            logical_device,
+            family_indices.drawing_family,
+            0,
+            &drawing_queue);
 
-    result = VK_ERROR_UNKNOWN;
-    vulkan_instance = {};
-    physical_device = VK_NULL_HANDLE;
-    logical_device = VK_NULL_HANDLE;
-    drawing_queue = VK_NULL_HANDLE;
-    presentation_queue = VK_NULL_HANDLE;
-    surface = VK_NULL_HANDLE;
-    swapchain = VK_NULL_HANDLE;
-    swapchain_image_format = VK_FORMAT_UNDEFINED;
-    swapchain_extent = {};
-    render_pass = {};
-    pipeline_layout = {};
-    graphics_pipeline = {};
-    command_pool = {};
+    render_pass = create_render_pass(
+            logical_device,
+            g_offscreen_format,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+    pipeline_layout = create_pipeline_layout(logical_device);
+    pipeline_cache.load(physical_device, logical_device);
+    graphics_pipeline = create_graphics_pipeline(
+            logical_device,
+            extent,
+            pipeline_layout,
+            render_pass,
+            pipeline_cache.handle());
 
-    swapchain_image_views.resize(0);
-    swapchain_images.resize(0);
-    swapchain_image_count = 0;
+    target = create_offscreen_target(physical_device, logical_device, render_pass);
 
-    family_indices = {0};
+    command_pool = create_command_pool(logical_device, family_indices);
+    command_buffer = create_command_buffer(logical_device, command_pool);
+    fence = create_vulkan_fence(logical_device);
 
-    g_msg_temp = g_program_name;
-    g_msg_temp += " running";
-    Log::i(g_msg_temp);
+    // Every frame is waited for, one frame worth of ring is enough.
+    ring.create(
+            physical_device,
+            logical_device,
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            0,
+            g_instance_region_size,
+            1);
+    instance_buffer = ring.buffer();
 
-    flags = SDL_INIT_VIDEO;
-    ret = SDL_Init(flags);
-    if (ret < 0) {
-        g_msg_temp = "Failed to initialize SDL: ";
-        g_msg_temp += SDL_GetError();
-        throw std::runtime_error(g_msg_temp);
-    }
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-    ret = SDL_SetHint(hint_name.c_str(), hint_value.c_str());
-    if (SDL_FALSE == ret) {
-        g_msg_temp = "Setting SDL hint ";
-        g_msg_temp += hint_name;
-        g_msg_temp += " failed";
-        Log::w(g_msg_temp);
-    }
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &command_buffer;
 
-    main_window = SDL_CreateWindow(
-            window_title.c_str(),
-            window_x,
-            window_y,
-            window_w,
-            window_h,
-            window_flags);
-    if (NULL == main_window) {
-        g_msg_temp = "Failed to create window: ";
-        g_msg_temp += SDL_GetError();
-        throw std::runtime_error(g_msg_temp);
-    }
+    time_start = std::chrono::steady_clock::now();
+
+    for (std::uint32_t frame = 0; frame < options.headless_frames; frame++) {
+        if (0 != frame) {
+            for (std::uint32_t tick = 0; tick < options.headless_ticks; tick++) {
+                if (player.is_open() && ! player.apply(game_state)) {
+                    break;
+                }
+                if (bot.active()) {
+                    bot.play(game_state, recorder.active() ? &recorder : nullptr);
+                }
+                game_state.tick();
+                recorder.record_tick(game_state);
+            }
+        }
 
-    Log::i("Sleeping for 1 second");
-    std::this_thread::sleep_for(
-            std::chrono::milliseconds(1000));
+        vkWaitForFences(logical_device, 1, &fence, VK_TRUE, UINT64_MAX);
+        vkResetFences(logical_device, 1, &fence);
 
-    SDL_Vulkan_GetInstanceExtensions(main_window, &extension_count, nullptr);
-    extension_names.resize(extension_count);
-    SDL_Vulkan_GetInstanceExtensions(main_window, &extension_count, extension_names.data());
+        ring.begin_frame(0);
+        instance_region = ring.allocate(g_instance_region_size, g_instance_region_alignment);
+        instance_count = upload_instances(game_state, instance_region);
 
-    application_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-    application_info.pApplicationName = application_name.c_str();
-    application_info.applicationVersion = VK_MAKE_VERSION(0, 0, 1);
-    application_info.pEngineName = engine_name.c_str();
-    application_info.engineVersion = VK_MAKE_VERSION(0, 0, 1);
-    application_info.apiVersion = VK_API_VERSION_1_0;
+        vkResetCommandBuffer(command_buffer, 0);
+        result = vkBeginCommandBuffer(command_buffer, &begin_info);
+        if (VK_SUCCESS != result) {
+            throw std::runtime_error("Failed to begin recording a command buffer");
+        }
 
-    create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-    create_info.pApplicationInfo = &application_info;
-    create_info.enabledExtensionCount = static_cast<uint32_t>(
-            extension_names.size());
-    create_info.ppEnabledExtensionNames = extension_names.data();
-    create_info.enabledLayerCount = 0; // Default to no validation layers
+        record_scene_pass(
+                command_buffer,
+                render_pass,
+                target.framebuffers[0],
+                extent,
+                pipeline_layout,
+                graphics_pipeline,
+                instance_buffer,
+                instance_region.offset,
+                instance_count);
+        record_offscreen_readback(command_buffer, target);
+
+        result = vkEndCommandBuffer(command_buffer);
+        if (VK_SUCCESS != result) {
+            throw std::runtime_error("Failed to end command buffer");
+        }
 
-    result = vkCreateInstance(&create_info, nullptr, &vulkan_instance);
-    if (VK_SUCCESS != result) {
-        g_msg_temp = "Failed to create Vulkan instance";
-        throw std::runtime_error(g_msg_temp);
+        result = vkQueueSubmit(drawing_queue, 1, &submit_info, fence);
+        if (VK_SUCCESS != result) {
+            throw std::runtime_error("Failed to submit draw command buffer");
+        }
+
+        vkWaitForFences(logical_device, 1, &fence, VK_TRUE, UINT64_MAX);
+
+        path = get_headless_frame_path(options, frame);
+        if (options.headless_raw) {
+            image_write_raw(
+                    path,
+                    static_cast<const std::uint8_t*>(target.readback_data),
+                    extent.width,
+                    extent.height,
+                    extent.width * g_offscreen_bytes_per_pixel);
+        } else {
+            image_write_png(
+                    path,
+                    static_cast<const std::uint8_t*>(target.readback_data),
+                    extent.width,
+                    extent.height,
+                    extent.width * g_offscreen_bytes_per_pixel);
+        }
     }
 
-    surface = create_surface(main_window, &vulkan_instance);
-    physical_device = pick_physical_device(&vulkan_instance, surface);
-    family_indices = find_queue_family_indices(physical_device, surface);
-    logical_device = create_logical_device(physical_device, family_indices);
-    vkGetDeviceQueue(
-            logical_device,
-            family_indices.drawing_family,
-            0,
-            &drawing_queue);
-    vkGetDeviceQueue(
-            logical_device,
-            family_indices.presentation_family,
-            0,
-            &presentation_queue);
+    elapsed_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - time_start).count();
+    LOG_I("Rendered {} frames of {}x{} in {} ms",
+            options.headless_frames,
+            extent.width,
+            extent.height,
+            elapsed_ms);
 
-    swapchain = create_swap_chain(
-            physical_device,
-            logical_device,
-            surface,
-            main_window,
-            swapchain_image_format,
-            swapchain_extent);
+    if (recorder.active()) {
+        recorder.write(options.record_path);
+        LOG_I("Replay written to {}", options.record_path);
+    }
 
-    vkGetSwapchainImagesKHR(
-            logical_device,
-            swapchain,
-            &swapchain_image_count,
-            nullptr);
-    swapchain_images.resize(swapchain_image_count);
-    vkGetSwapchainImagesKHR(
-            logical_device,
-            swapchain,
-            &swapchain_image_count,
-            swapchain_images.data());
+    vkDeviceWaitIdle(logical_device);
 
-    swapchain_image_views = create_image_views(
-            logical_device,
-            swapchain_images,
-            swapchain_image_format);
+    pipeline_cache.save(logical_device);
 
-    render_pass = create_render_pass(
-            logical_device,
-            swapchain_image_format);
+    vkDestroyFence(logical_device, fence, nullptr);
+    vkDestroyCommandPool(logical_device, command_pool, nullptr);
+    ring.destroy(logical_device);
+    destroy_offscreen_target(logical_device, target);
+    vkDestroyPipeline(logical_device, graphics_pipeline, nullptr);
+    pipeline_cache.destroy(logical_device);
+    vkDestroyPipelineLayout(logical_device, pipeline_layout, nullptr);
+    vkDestroyRenderPass(logical_device, render_pass, nullptr);
+    vkDestroyDevice(logical_device, nullptr);
+    vkDestroyInstance(vulkan_instance, nullptr);
 
-    pipeline_layout = create_pipeline_layout(logical_device);
+    return 0;
+}
 
-    Log::i("Creating Vulkan graphics pipeline");
-    graphics_pipeline = create_graphics_pipeline(
-            logical_device,
-            swapchain_extent,
-            pipeline_layout,
-            render_pass);
+static void
+print_usage(void)
+{
+    std::cout << "Usage: " << g_program_name << " [options]\n";
+    std::cout << "\t--frames-in-flight <1.."
+        << g_max_frames_in_flight << ">\n";
+    std::cout << "\t\tFrames CPU may record ahead of GPU. Default "
+        << g_default_frames_in_flight << ".\n";
+    std::cout << "\t--present-mode <fifo|fifo-relaxed|mailbox|immediate>\n";
+    std::cout << "\t\tPreferred present mode, falling back to another low\n";
+    std::cout << "\t\tlatency mode and then fifo. Default fifo.\n";
+    std::cout << "\t--fps-limit <n>\n";
+    std::cout << "\t\tPresent at most n frames per second. Unlimited by\n";
+    std::cout << "\t\tdefault.\n";
+    std::cout << "\t--prerecord\n";
+    std::cout << "\t\tRecord command buffers once per swapchain image and\n";
+    std::cout << "\t\tonly record again when game state has changed.\n";
+    std::cout << "\t--startup-budget <ms>\n";
+    std::cout << "\t\tQuit after the first frame, exit with failure when\n";
+    std::cout << "\t\tit took longer than given milliseconds to present.\n";
+    std::cout << "\t--binary-log <path>\n";
+    std::cout << "\t\tWrite log unformatted to a file instead of stdout,\n";
+    std::cout << "\t\tto be read with log_decode.\n";
+    std::cout << "\t--log-level <debug|info|warn|error>\n";
+    std::cout << "\t\tLeast severe messages to log. Default info.\n";
+    std::cout << "\t--frame-stats <path>\n";
+    std::cout << "\t\tWrite CPU and GPU frame timings as CSV at exit.\n";
+    std::cout << "\t--seed <n>\n";
+    std::cout << "\t\tSeed of the piece randomizer. Random by default.\n";
+    std::cout << "\t--randomizer <bag|classic>\n";
+    std::cout << "\t\tDeal pieces in shuffled bags of seven, or each one\n";
+    std::cout << "\t\tindependently. Default bag.\n";
+    std::cout << "\t--headless <directory>\n";
+    std::cout << "\t\tRun without a window, rendering frames offscreen\n";
+    std::cout << "\t\tand writing them as PNG into directory.\n";
+    std::cout << "\t--headless-frames <n>\n";
+    std::cout << "\t\tFrames to write in headless mode. Default 1.\n";
+    std::cout << "\t--headless-ticks <n>\n";
+    std::cout << "\t\tSimulation ticks between headless frames. Default "
+        << GAME_TICK_RATE << ".\n";
+    std::cout << "\t--headless-raw\n";
+    std::cout << "\t\tWrite bare RGBA pixels instead of PNG.\n";
+    std::cout << "\t--record <path>\n";
+    std::cout << "\t\tWrite a replay of the game at exit.\n";
+    std::cout << "\t--replay <path>\n";
+    std::cout << "\t\tPlay back a replay, also in headless mode.\n";
+    std::cout << "\t--replay-keyframe <n>\n";
+    std::cout << "\t\tStart playback from keyframe n. Default 0.\n";
+    std::cout << "\t--bot\n";
+    std::cout << "\t\tLet the computer play, also in headless mode.\n";
+    std::cout << "\t--bot-beam <n>\n";
+    std::cout << "\t\tPositions the bot keeps per searched piece. Default "
+        << Bot::default_settings().beam_width << ".\n";
+    std::cout << "\t--bot-budget <us>\n";
+    std::cout << "\t\tTime the bot may search per piece. Default "
+        << Bot::default_settings().budget.count() << ".\n";
+    std::cout << "\t--bot-threads <n>\n";
+    std::cout << "\t\tThreads the bot searches with, 0 for one per\n";
+    std::cout << "\t\thardware thread. Default 0.\n";
+    std::cout << "\t--bot-table <0.." << g_max_bot_table_bits << ">\n";
+    std::cout << "\t\tBot transposition table of 2^n 64 byte cache lines,\n";
+    std::cout << "\t\t0 for none, " << g_max_bot_table_bits << " taking "
+        << (64ull << g_max_bot_table_bits >> 30) << " GiB. Default "
+        << Bot::default_settings().table_bits << ", "
+        << (64ull << Bot::default_settings().table_bits >> 20) << " MiB.\n";
+}
 
-    swapchain_framebuffers = create_framebuffers(
-            logical_device,
-            swapchain_image_views,
-            render_pass,
-            swapchain_extent);
+static const char*
+require_option_value(const std::string& name, const char* value)
+{
+    if (nullptr == value) {
+        g_msg_temp = "Missing value for option ";
+        g_msg_temp += name;
+        throw std::runtime_error(g_msg_temp);
+    }
 
-    command_pool = create_command_pool(
-            logical_device,
-            family_indices);
+    return value;
+}
 
-    command_buffer = create_command_buffer(
-            logical_device,
-            command_pool);
+[[noreturn]] static void
+throw_invalid_option_value(const std::string& name, const char* value)
+{
+    g_msg_temp = "Invalid value for option ";
+    g_msg_temp += name;
+    g_msg_temp += ": ";
+    g_msg_temp += value;
+    throw std::runtime_error(g_msg_temp);
+}
 
-    semaphore_image_available = create_vulkan_semaphore(logical_device);
-    semaphore_render_finished = create_vulkan_semaphore(logical_device);
-    fence_in_flight = create_vulkan_fence(logical_device);
+static std::uint32_t
+parse_option_uint(const std::string& name, const char* value)
+{
+    char* end;
+    unsigned long parsed;
 
-    draw_frame(
-            logical_device,
-            fence_in_flight,
-            swapchain,
-            semaphore_image_available,
-            semaphore_render_finished,
-            command_buffer,
-            render_pass,
-            swapchain_framebuffers,
-            swapchain_extent,
-            graphics_pipeline,
-            drawing_queue,
-            presentation_queue);
+    end = nullptr;
 
-#if 0
-    // TODO Main loop here
-    while (1 /* loop until window close event */) {
-    }
-#endif
+    require_option_value(name, value);
 
-    Log::i("Sleeping for 1 second");
-    std::this_thread::sleep_for(
-            std::chrono::milliseconds(1000));
+    parsed = std::strtoul(value, &end, 10);
+    if (end == value || '\0' != *end) {
+        throw_invalid_option_value(name, value);
+    }
 
-    g_msg_temp = g_program_name;
-    g_msg_temp += " shutting down";
-    Log::i(g_msg_temp);
+    return static_cast<std::uint32_t>(parsed);
+}
 
-    vkDestroySemaphore(logical_device, semaphore_image_available, nullptr);
-    vkDestroySemaphore(logical_device, semaphore_render_finished, nullptr);
-    vkDestroyFence(logical_device, fence_in_flight, nullptr);
+static std::string
+parse_option_string(const std::string& name, const char* value)
+{
+    return require_option_value(name, value);
+}
 
-    vkDestroyCommandPool(logical_device, command_pool, nullptr);
+static std::int32_t
+parse_option_name(
+        const std::string& name,
+        const char* value,
+        const struct OptionName* names,
+        std::size_t count)
+{
+    require_option_value(name, value);
 
-    for (VkFramebuffer framebuffer : swapchain_framebuffers) {
-        vkDestroyFramebuffer(logical_device, framebuffer, nullptr);
+    for (std::size_t i = 0; i < count; i++) {
+        if (0 == std::strcmp(names[i].name, value)) {
+            return names[i].value;
+        }
     }
 
-    vkDestroyPipeline(logical_device, graphics_pipeline, nullptr);
-    vkDestroyPipelineLayout(logical_device, pipeline_layout, nullptr);
-    vkDestroyRenderPass(logical_device, render_pass, nullptr);
+    throw_invalid_option_value(name, value);
+}
 
-    for (VkImageView image_view : swapchain_image_views) {
-        vkDestroyImageView(logical_device, image_view, nullptr);
+static struct Options
+parse_options(int argc, char* argv[])
+{
+    std::string argument;
+    struct Options options;
+
+    options = {};
+    options.frames_in_flight = g_default_frames_in_flight;
+    options.present_mode = VK_PRESENT_MODE_FIFO_KHR;
+    options.log_level = LOG_LEVEL_INFO;
+    options.seed = std::random_device{}();
+    options.randomizer = RANDOMIZER_BAG;
+    options.headless_frames = 1;
+    options.headless_ticks = GAME_TICK_RATE;
+    options.bot_settings = Bot::default_settings();
+
+    for (int i = 1; i < argc; i++) {
+        argument = argv[i];
+
+        if ("--frames-in-flight" == argument) {
+            options.frames_in_flight = parse_option_uint(argument, argv[++i]);
+            if (options.frames_in_flight < 1 ||
+                    options.frames_in_flight > g_max_frames_in_flight) {
+                throw std::runtime_error("--frames-in-flight out of range");
+            }
+        } else if ("--present-mode" == argument) {
+            options.present_mode = static_cast<VkPresentModeKHR>(parse_option_name(
+                        argument,
+                        argv[++i],
+                        g_present_mode_names,
+                        std::size(g_present_mode_names)));
+        } else if ("--fps-limit" == argument) {
+            options.fps_limit = parse_option_uint(argument, argv[++i]);
+        } else if ("--prerecord" == argument) {
+            options.prerecord = true;
+        } else if ("--startup-budget" == argument) {
+            options.startup_budget_ms = parse_option_uint(argument, argv[++i]);
+        } else if ("--binary-log" == argument) {
+            options.binary_log_path = parse_option_string(argument, argv[++i]);
+        } else if ("--log-level" == argument) {
+            options.log_level = parse_option_name(
+                    argument,
+                    argv[++i],
+                    g_log_level_names,
+                    std::size(g_log_level_names));
+        } else if ("--frame-stats" == argument) {
+            options.frame_stats_path = parse_option_string(argument, argv[++i]);
+        } else if ("--seed" == argument) {
+            options.seed = parse_option_uint(argument, argv[++i]);
+        } else if ("--randomizer" == argument) {
+            options.randomizer = parse_option_name(
+                    argument,
+                    argv[++i],
+                    g_randomizer_names,
+                    std::size(g_randomizer_names));
+        } else if ("--headless" == argument) {
+            options.headless_directory = parse_option_string(argument, argv[++i]);
+        } else if ("--headless-frames" == argument) {
+            options.headless_frames = parse_option_uint(argument, argv[++i]);
+        } else if ("--headless-ticks" == argument) {
+            options.headless_ticks = parse_option_uint(argument, argv[++i]);
+        } else if ("--headless-raw" == argument) {
+            options.headless_raw = true;
+        } else if ("--record" == argument) {
+            options.record_path = parse_option_string(argument, argv[++i]);
+        } else if ("--replay" == argument) {
+            options.replay_path = parse_option_string(argument, argv[++i]);
+        } else if ("--replay-keyframe" == argument) {
+            options.replay_keyframe = parse_option_uint(argument, argv[++i]);
+        } else if ("--bot" == argument) {
+            options.bot = true;
+        } else if ("--bot-beam" == argument) {
+            options.bot_settings.beam_width = parse_option_uint(argument, argv[++i]);
+            if (options.bot_settings.beam_width < 1) {
+                throw std::runtime_error("--bot-beam out of range");
+            }
+        } else if ("--bot-budget" == argument) {
+            options.bot_settings.budget = std::chrono::microseconds(
+                    parse_option_uint(argument, argv[++i]));
+        } else if ("--bot-threads" == argument) {
+            options.bot_settings.thread_count = parse_option_uint(argument, argv[++i]);
+        } else if ("--bot-table" == argument) {
+            options.bot_settings.table_bits = parse_option_uint(argument, argv[++i]);
+            if (options.bot_settings.table_bits < 0 ||
+                    options.bot_settings.table_bits > g_max_bot_table_bits) {
+                throw std::runtime_error("--bot-table out of range");
+            }
+        } else if ("--help" == argument || "-h" == argument) {
+            print_usage();
+            std::exit(0);
+        } else {
+            print_usage();
+            g_msg_temp = "Unknown option: ";
+            g_msg_temp += argument;
+            throw std::runtime_error(g_msg_temp);
+        }
     }
 
-    vkDestroySwapchainKHR(logical_device, swapchain, nullptr);
-    vkDestroyDevice(logical_device, nullptr);
-    vkDestroySurfaceKHR(vulkan_instance, surface, nullptr);
-    vkDestroyInstance(vulkan_instance, nullptr);
-
-    SDL_Quit();
+    return options;
 }
 
 // Disable name mangling so that SDL can find and redefine main.
 // https://djrollins.com/2016/10/02/sdl-on-windows/
 extern "C" int main(int argc, char* argv[])
 {
+    int exit_status;
+    struct Options options;
+
+    exit_status = 0;
+
     try {
-        game();
+        options = parse_options(argc, argv);
+        Log::set_level(options.log_level);
+        Log::start(options.binary_log_path);
+        if (options.headless_directory.empty()) {
+            exit_status = game(options);
+        } else {
+            exit_status = headless(options);
+        }
     } catch(std::exception const& e) {
-        std::string msg = "Terminating due to unhandled exception: ";
-        msg += e.what();
-        Log::e(msg);
+        LOG_E("Terminating due to unhandled exception: {}", e.what());
+        exit_status = 1;
     }
 
-    return 0;
+    Log::stop();
+
+    return exit_status;
 }
@@ -0,0 +1,138 @@
+/*
+ * Formats a binary log written with --binary-log into the same text the game
+ * prints to stdout when no binary log is used.
+ *
+ * Usage: log_decode <file>, or binary log from stdin when no file is given.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "LogRecord.hpp"
+
+static bool
+read_exact(std::FILE* file, void* data, std::size_t size)
+{
+    return size == std::fread(data, 1, size, file);
+}
+
+static int
+report_truncated(std::FILE* file)
+{
+    if (std::ferror(file)) {
+        std::fprintf(stderr, "Failed to read binary log\n");
+    } else {
+        std::fprintf(stderr, "Binary log is truncated\n");
+    }
+
+    return 1;
+}
+
+static int
+decode(std::FILE* file)
+{
+    char magic[LOG_BINARY_MAGIC_SIZE];
+    char line[LOG_LINE_MAX];
+    std::uint8_t entry;
+    std::uint32_t id;
+    std::uint8_t level;
+    std::uint16_t length;
+    LogRecord record;
+    const char* format;
+    std::vector<std::string> formats;
+    // Ids seen in a format entry, formats below the largest may be missing.
+    std::vector<bool> registered;
+
+    if ( ! read_exact(file, magic, sizeof(magic)) ||
+            0 != std::memcmp(magic, LOG_BINARY_MAGIC, sizeof(magic))) {
+        std::fprintf(stderr, "Not a binary log\n");
+        return 1;
+    }
+
+    formats.resize(0);
+    registered.resize(0);
+
+    // A log cut short, by a crash for example, ends partway through an
+    // entry. Only running out between entries is a clean end.
+    while (read_exact(file, &entry, sizeof(entry))) {
+        if (LOG_ENTRY_FORMAT == entry) {
+            if ( ! read_exact(file, &id, sizeof(id)) ||
+                    ! read_exact(file, &level, sizeof(level)) ||
+                    ! read_exact(file, &length, sizeof(length))) {
+                return report_truncated(file);
+            }
+            if (id >= LOG_MAX_FORMATS) {
+                std::fprintf(stderr, "Binary log is corrupt, format id %u\n", id);
+                return 1;
+            }
+            if (id >= formats.size()) {
+                formats.resize(id + 1);
+                registered.resize(id + 1, false);
+            }
+            formats[id].resize(length);
+            if ( ! read_exact(file, formats[id].data(), length)) {
+                return report_truncated(file);
+            }
+            registered[id] = true;
+        } else if (LOG_ENTRY_RECORD == entry) {
+            if ( ! read_exact(file, &record, LOG_RECORD_HEADER_SIZE)) {
+                return report_truncated(file);
+            }
+            if (record.length > sizeof(record.data)) {
+                std::fprintf(stderr, "Binary log is corrupt, record length %u\n",
+                        static_cast<unsigned>(record.length));
+                return 1;
+            }
+            if ( ! read_exact(file, record.data, record.length)) {
+                return report_truncated(file);
+            }
+
+            format = nullptr;
+            if (LOG_RECORD_ARGS == record.type) {
+                id = log_record_format_id(record);
+                if (id < formats.size() && registered[id]) {
+                    format = formats[id].c_str();
+                }
+            }
+
+            std::fwrite(line, 1, log_format_line(record, format, line), stdout);
+        } else {
+            std::fprintf(stderr, "Binary log is corrupt, entry type %u\n", entry);
+            return 1;
+        }
+    }
+
+    if ( ! std::feof(file)) {
+        std::fprintf(stderr, "Failed to read binary log\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    int ret;
+    std::FILE* file;
+
+    if (argc > 2) {
+        std::fprintf(stderr, "Usage: %s [binary log]\n", argv[0]);
+        return 2;
+    }
+
+    file = argc == 2 ? std::fopen(argv[1], "rb") : stdin;
+    if (nullptr == file) {
+        std::fprintf(stderr, "Failed to open %s\n", argv[1]);
+        return 1;
+    }
+
+    ret = decode(file);
+
+    if (stdin != file) {
+        std::fclose(file);
+    }
+
+    return ret;
+}